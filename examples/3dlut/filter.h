@@ -24,29 +24,6 @@ class LutFilter
         return x;
     }
 
-    static inline void quantize(int* i, float* fracval, float x, int sz) {
-
-        // clamp to 0-1
-        x = std::max(x, 0.0f);
-        x = std::min(x, 1.0f);
-
-        float px = (sz - 1) * x;
-        float s = std::floor(px); // int part
-        float u = px - s;    // frac part
-
-        int   x0 = (int)px;
-        if (x0 < 0) x0 = 0;
-        if (x0 > (sz - 1)) x0 = sz - 1;
-
-        (*fracval) = u;
-        (*i) = x0;
-
-    }
-
-    static inline float lerp(float t, float a, float b) {
-        return a + (b - a) * t;
-    }
-
   public:
     LutFilter() {};
     ~LutFilter() {
@@ -57,46 +34,31 @@ class LutFilter
 
     /// If LUT was successfully initialized in Load(), return true.
     bool IsValid() {
-        return !data.empty();
+        return evaluator.view().data_ != nullptr;
     }
 
     /// Apply 3D LUT to input color.
     inline void Apply(float col[3], float r, float g, float b) const {
-
         // trilinear interpolation
+        const float rgb[3] = {r, g, b};
+        evaluator.eval(rgb, col);
+    }
 
-        int ix0, iy0, iz0;
-        float fx, fy, fz;
-        quantize(&ix0, &fx, r, dim[0]);
-        quantize(&iy0, &fy, g, dim[1]);
-        quantize(&iz0, &fz, b, dim[2]);
-        //printf("quant: %f -> %d, %f\n", r, ix0, fx);
-
-        int ix1 = ((ix0 + 1) >= dim[0]) ? (dim[0] - 1) : (ix0 + 1);
-        int iy1 = ((iy0 + 1) >= dim[1]) ? (dim[1] - 1) : (iy0 + 1);
-        int iz1 = ((iz0 + 1) >= dim[2]) ? (dim[2] - 1) : (iz0 + 1);
+    /// Apply 3D LUT to `count` RGB pixels(`dst` can be `src`).
+    void ApplyBatch(const float *src, float *dst, size_t count) const {
+        tinycolorio::ApplyBatch(evaluator, src, dst, count);
+    }
 
-        for (int i = 0; i < 3; i++) {
+    /// Apply 3D LUT to `count` 8-bit RGB pixels, writing 16-bit RGB. Integer
+    /// math only. Fails when no LUT is loaded.
+    bool ApplyBatch(const uint8_t *src, uint16_t *dst, size_t count) const {
+        return tinycolorio::ApplyBatch(int_evaluator, src, dst, count);
+    }
 
-            int i000 = iz0 * dim[1] * dim[0] + iy0 * dim[0] + ix0;
-            int i001 = iz0 * dim[1] * dim[0] + iy0 * dim[0] + ix1;
-            int i010 = iz0 * dim[1] * dim[0] + iy1 * dim[0] + ix0;
-            int i011 = iz0 * dim[1] * dim[0] + iy1 * dim[0] + ix1;
-            int i100 = iz1 * dim[1] * dim[0] + iy0 * dim[0] + ix0;
-            int i101 = iz1 * dim[1] * dim[0] + iy0 * dim[0] + ix1;
-            int i110 = iz1 * dim[1] * dim[0] + iy1 * dim[0] + ix0;
-            int i111 = iz1 * dim[1] * dim[0] + iy1 * dim[0] + ix1;
-
-            float d00 = lerp(fx, data[3*i000+i], data[3*i001+i]);
-            float d10 = lerp(fx, data[3*i010+i], data[3*i011+i]);
-            float d01 = lerp(fx, data[3*i100+i], data[3*i101+i]);
-            float d11 = lerp(fx, data[3*i110+i], data[3*i111+i]);
-            float d0  = lerp(fy, d00, d10);
-            float d1  = lerp(fy, d01, d11);
-            float d   = lerp(fz, d0, d1);
-
-            col[i] = d;
-        } 
+    /// Select trilinear or tetrahedral interpolation.
+    void SetInterpolation(tinycolorio::LUT3DInterpolation interpolation) {
+        evaluator.set_interpolation(interpolation);
+        int_evaluator.set_interpolation(interpolation);
     }
 
     /// For numeric debugging
@@ -131,8 +93,8 @@ class LutFilter
         }
     }    
 
-    std::vector<float> data;
-    int   dim[3];
+    tinycolorio::LUT3DEvaluator evaluator;  // size specialized for 17/33/65
+    tinycolorio::LUT3DIntegerEvaluator int_evaluator;  // 8-bit in, 16-bit out
 };
 
 }
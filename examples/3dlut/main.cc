@@ -6,6 +6,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -22,7 +23,7 @@ unsigned char fclamp(float x) {
 }
 
 bool LoadImage(const char *filename, int *width,
-               int *height, std::vector<float> *image) {
+               int *height, std::vector<unsigned char> *image) {
 
   int channels = 0;
   unsigned char *data = stbi_load(filename, width, height, &channels, /* desired channels */3);
@@ -31,23 +32,26 @@ bool LoadImage(const char *filename, int *width,
     return false;
   }
 
-  image->resize((*width) * (*height) * 3);
-
-  for (size_t i = 0; i < (*width) * (*height) * 3; i++) {
-    (*image)[i] = data[i] / 255.0f; // [0.0, 1.0]
-  }
+  // 8-bit codes as is, the LUT is applied with integer math.
+  image->assign(data, data + size_t(*width) * size_t(*height) * 3);
 
   free(data);
 
   return true;
 }
 
-void SaveImagePNG(const char *filename, const float *rgb, int width,
+void SaveImagePNG(const char *filename, const uint16_t *rgb, int width,
                   int height) {
 
+  // fclamp() of every 16-bit code, instead of powf() per pixel.
+  std::vector<unsigned char> gamma(65536);
+  for (size_t i = 0; i < gamma.size(); i++) {
+    gamma[i] = fclamp(float(i) / 65535.0f);
+  }
+
   std::vector<unsigned char> ldr(width * height * 3);
   for (size_t i = 0; i < (size_t)(width * height * 3); i++) {
-    ldr[i] = fclamp(rgb[i]);
+    ldr[i] = gamma[rgb[i]];
   }
 
   int len = stbi_write_png(filename, width, height, 3, &ldr.at(0), width * 3);
@@ -57,40 +61,29 @@ void SaveImagePNG(const char *filename, const float *rgb, int width,
   }
 }
 
-static void Apply(
+static bool Apply(
   const example::LutFilter &filter, 
-  const std::vector<float> &src,
+  const std::vector<unsigned char> &src,
   const int width,
   const int height,
-  std::vector<float> *dst) {
+  std::vector<uint16_t> *dst) {
 
   dst->resize(width * height * 3);
 
-  for (size_t i = 0; i < width * height; i++) {
-
-    float ret[3];
-
-    float r = src[3 * i + 0];
-    float g = src[3 * i + 1];
-    float b = src[3 * i + 2];
-
-    filter.Apply(ret, r, g, b);
-
-    (*dst)[3 * i + 0] = ret[0];
-    (*dst)[3 * i + 1] = ret[1];
-    (*dst)[3 * i + 2] = ret[2];
-  }
+  return filter.ApplyBatch(src.data(), dst->data(),
+                           size_t(width) * size_t(height));
 }
 
 int main(int argc, char **argv)
 {
-  if (argc < 3) {
-    std::cerr << "Requires input.png input.lut output.png" << std::endl;
+  if (argc < 4) {
+    std::cerr << "Requires input.png input.lut output.png [tetrahedral]"
+              << std::endl;
     return EXIT_FAILURE;
   }
 
   int width, height;
-  std::vector<float> src;
+  std::vector<unsigned char> src;
 
   // load image
   if (!LoadImage(argv[1], &width, &height, &src)) {
@@ -103,10 +96,17 @@ int main(int argc, char **argv)
     return EXIT_FAILURE;
   }
 
-  std::vector<float> dst;
+  if ((argc > 4) && (strcmp(argv[4], "tetrahedral") == 0)) {
+    lut_filter.SetInterpolation(tinycolorio::LUT3DInterpolation::kTetrahedral);
+  }
+
+  std::vector<uint16_t> dst;
 
   // Apply 3D LUT
-  Apply(lut_filter, src, width, height, &dst);
+  if (!Apply(lut_filter, src, width, height, &dst)) {
+    std::cerr << "Failed to apply 3D LUT" << std::endl;
+    return EXIT_FAILURE;
+  }
 
   // Save color correct image.
   SaveImagePNG(argv[3], dst.data(), width, height);
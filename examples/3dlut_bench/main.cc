@@ -0,0 +1,338 @@
+// Compares 3D LUT layouts(interleaved, padded RGBA, bricked RGBA) and the
+// cell-major LUT3DCells on an image, reporting memory, time per pixel and
+// cache misses per pixel. Then compares trilinear and tetrahedral
+// interpolation on 17^3, 33^3 and 65^3 LUTs(time per pixel and error
+// against the function the LUT was sampled from).
+//
+//   $ make
+//   $ ./lut3d_bench [image.png]
+//
+// Without an image a smooth synthetic 1920x1080 image is used. Cache misses
+// are read with perf_event_open(Linux) and shown as "n/a" when hardware
+// counters are not available(e.g. in most VMs and containers).
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define TINY_COLOR_IO_IMPLEMENTATION
+#include "tiny-color-io.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Hardware event counter. value() returns -1 when unavailable.
+class PerfCounter {
+ public:
+  PerfCounter(uint32_t type, uint64_t config) {
+#if defined(__linux__)
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+    (void)type;
+    (void)config;
+#endif
+  }
+
+  ~PerfCounter() {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+#endif
+  }
+
+  void start() {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  }
+
+  void stop() {
+#if defined(__linux__)
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    }
+#endif
+  }
+
+  int64_t value() const {
+#if defined(__linux__)
+    uint64_t v = 0;
+    if ((fd_ >= 0) && (read(fd_, &v, sizeof(v)) == sizeof(v))) {
+      return int64_t(v);
+    }
+#endif
+    return -1;
+  }
+
+ private:
+  int fd_{-1};
+};
+
+#if defined(__linux__)
+const uint64_t kL1DReadMiss = PERF_COUNT_HW_CACHE_L1D |
+                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+#endif
+
+bool LoadImage(const char *filename, int *width, int *height,
+               std::vector<float> *image) {
+  int channels = 0;
+  unsigned char *data = stbi_load(filename, width, height, &channels, 3);
+  if (!data) {
+    fprintf(stderr, "Failed to load image : %s\n", filename);
+    return false;
+  }
+
+  const size_t n = size_t(*width) * size_t(*height) * 3;
+  image->resize(n);
+  for (size_t i = 0; i < n; i++) {
+    (*image)[i] = data[i] / 255.0f;
+  }
+
+  stbi_image_free(data);
+  return true;
+}
+
+// Smooth gradients with low frequency variation and a little noise, so
+// neighboring pixels fall into nearby LUT cells like in a photograph.
+void SyntheticImage(int width, int height, std::vector<float> *image) {
+  image->resize(size_t(width) * size_t(height) * 3);
+  uint32_t seed = 1;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      const float u = float(x) / float(width);
+      const float v = float(y) / float(height);
+      const float base[3] = {
+          0.5f + 0.4f * std::sin(6.0f * u + 2.0f * v),
+          0.5f + 0.4f * std::sin(4.0f * v + 1.0f) * std::cos(3.0f * u),
+          0.5f + 0.4f * std::cos(5.0f * (u - v))};
+      for (int c = 0; c < 3; c++) {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = (float(seed >> 8) / float(1 << 24) - 0.5f) * 0.02f;
+        (*image)[3 * (size_t(y) * size_t(width) + size_t(x)) + size_t(c)] =
+            base[c] + noise;
+      }
+    }
+  }
+}
+
+// Film-like look: contrast curve plus a channel crosstalk.
+void Look(const float in[3], float out[3]) {
+  for (int c = 0; c < 3; c++) {
+    const float m =
+        0.8f * in[c] + 0.1f * in[(c + 1) % 3] + 0.1f * in[(c + 2) % 3];
+    out[c] = m * m * (3.0f - 2.0f * m);
+  }
+}
+
+void BuildLUT(size_t n, tinycolorio::LUT3Df *lut) {
+  lut->create(n, n, n);
+  for (size_t z = 0; z < n; z++) {
+    for (size_t y = 0; y < n; y++) {
+      for (size_t x = 0; x < n; x++) {
+        const float in[3] = {float(x) / float(n - 1), float(y) / float(n - 1),
+                             float(z) / float(n - 1)};
+        float out[3];
+        Look(in, out);
+        lut->set(x, y, z, out);
+      }
+    }
+  }
+}
+
+template <typename LUT>
+void Bench(const char *name, const LUT &lut, const std::vector<float> &image,
+           std::vector<float> *out) {
+  const size_t num_pixels = image.size() / 3;
+  const int kRepeat = 5;
+
+#if defined(__linux__)
+  PerfCounter l1_misses(PERF_TYPE_HW_CACHE, kL1DReadMiss);
+  PerfCounter llc_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+#else
+  PerfCounter l1_misses(0, 0);
+  PerfCounter llc_misses(0, 0);
+#endif
+
+  double best = 1e30;
+  int64_t l1 = -1;
+  int64_t llc = -1;
+  for (int r = 0; r < kRepeat; r++) {
+    l1_misses.start();
+    llc_misses.start();
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_pixels; i++) {
+      tinycolorio::EvalTrilinear(lut, &image[3 * i], &(*out)[3 * i]);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    l1_misses.stop();
+    llc_misses.stop();
+
+    const double t = std::chrono::duration<double>(t1 - t0).count();
+    if (t < best) {
+      best = t;
+      l1 = l1_misses.value();
+      llc = llc_misses.value();
+    }
+  }
+
+  char l1_str[32] = "n/a";
+  char llc_str[32] = "n/a";
+  if (l1 >= 0) {
+    snprintf(l1_str, sizeof(l1_str), "%.3f", double(l1) / double(num_pixels));
+  }
+  if (llc >= 0) {
+    snprintf(llc_str, sizeof(llc_str), "%.3f",
+             double(llc) / double(num_pixels));
+  }
+  const double mib =
+      double(lut.data_.size() * sizeof(lut.data_[0])) / (1024.0 * 1024.0);
+  printf("  %-12s %8.2f MiB %8.2f ns/px  L1D miss/px %8s  LLC miss/px %8s\n",
+         name, mib, best / double(num_pixels) * 1e9, l1_str, llc_str);
+}
+
+// Time and error against Look() of the evaluator's interpolation.
+void BenchInterpolation(const char *name,
+                        const tinycolorio::LUT3DEvaluator &evaluator,
+                        const std::vector<float> &image,
+                        std::vector<float> *out) {
+  const size_t num_pixels = image.size() / 3;
+  const int kRepeat = 5;
+
+  double best = 1e30;
+  for (int r = 0; r < kRepeat; r++) {
+    auto t0 = std::chrono::steady_clock::now();
+    tinycolorio::ApplyBatch(evaluator, image.data(), out->data(), num_pixels);
+    auto t1 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(t1 - t0).count());
+  }
+
+  double sum = 0.0;
+  double max_err = 0.0;
+  for (size_t i = 0; i < num_pixels; i++) {
+    // The LUT covers [0, 1].
+    float in[3];
+    for (int c = 0; c < 3; c++) {
+      in[c] = std::min(std::max(image[3 * i + size_t(c)], 0.0f), 1.0f);
+    }
+    float expected[3];
+    Look(in, expected);
+    for (int c = 0; c < 3; c++) {
+      const double e =
+          std::fabs(double((*out)[3 * i + size_t(c)]) - double(expected[c]));
+      sum += e;
+      max_err = std::max(max_err, e);
+    }
+  }
+
+  printf("  %-12s %8.2f ns/px  mean error %.3e  max error %.3e\n", name,
+         best / double(num_pixels) * 1e9, sum / double(3 * num_pixels),
+         max_err);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int width = 1920;
+  int height = 1080;
+  std::vector<float> image;
+  if (argc > 1) {
+    if (!LoadImage(argv[1], &width, &height, &image)) {
+      return EXIT_FAILURE;
+    }
+  } else {
+    SyntheticImage(width, height, &image);
+  }
+  printf("image %dx%d\n", width, height);
+
+  std::vector<float> out(image.size());
+
+  const size_t sizes[] = {33, 65, 129};
+  for (size_t n : sizes) {
+    tinycolorio::LUT3Df lut;
+    BuildLUT(n, &lut);
+    printf("%zu^3 LUT\n", n);
+
+    Bench("interleaved", lut, image, &out);
+
+    lut.convert(tinycolorio::LUT3DLayout::kPaddedRGBA);
+    Bench("padded", lut, image, &out);
+
+    lut.convert(tinycolorio::LUT3DLayout::kBrickedRGBA);
+    Bench("bricked", lut, image, &out);
+
+    tinycolorio::LUT3DCellsf cells;
+    cells.build(lut);
+    Bench("cells", cells, image, &out);
+  }
+
+  printf("interpolation(padded RGBA, LUT3DEvaluator, ApplyBatch)\n");
+  const size_t interpolation_sizes[] = {17, 33, 65};
+  for (size_t n : interpolation_sizes) {
+    tinycolorio::LUT3Df lut;
+    BuildLUT(n, &lut);
+    printf("%zu^3 LUT\n", n);
+
+    tinycolorio::LUT3DEvaluator evaluator;
+    evaluator.init(std::move(lut));
+    BenchInterpolation("trilinear", evaluator, image, &out);
+
+    evaluator.set_interpolation(tinycolorio::LUT3DInterpolation::kTetrahedral);
+    BenchInterpolation("tetrahedral", evaluator, image, &out);
+  }
+
+  printf("ApplyBatch kernels(33^3 LUT, padded RGBA)\n");
+  {
+    tinycolorio::LUT3Df lut;
+    BuildLUT(33, &lut);
+    tinycolorio::LUT3DEvaluator evaluator;
+    evaluator.init(std::move(lut));
+
+    const tinycolorio::SIMDLevel levels[] = {
+        tinycolorio::SIMDLevel::kScalar, tinycolorio::SIMDLevel::kSSE41,
+        tinycolorio::SIMDLevel::kAVX2, tinycolorio::SIMDLevel::kAVX512};
+    const char *level_names[] = {"scalar", "sse4.1", "avx2", "avx512"};
+    for (size_t i = 0; i < 4; i++) {
+      tinycolorio::SetMaxSIMDLevel(levels[i]);
+      if (tinycolorio::GetSIMDLevel() != levels[i]) {
+        printf("  %-12s not supported\n", level_names[i]);
+        continue;
+      }
+      char name[32];
+      snprintf(name, sizeof(name), "%s tri", level_names[i]);
+      evaluator.set_interpolation(tinycolorio::LUT3DInterpolation::kTrilinear);
+      BenchInterpolation(name, evaluator, image, &out);
+      snprintf(name, sizeof(name), "%s tet", level_names[i]);
+      evaluator.set_interpolation(
+          tinycolorio::LUT3DInterpolation::kTetrahedral);
+      BenchInterpolation(name, evaluator, image, &out);
+    }
+    tinycolorio::SetMaxSIMDLevel(tinycolorio::SIMDLevel::kAVX512);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+// libFuzzer target for LUT parsers.
+//
+//   $ make
+//   $ ./fuzz_lut -max_len=65536 corpus/
+//
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define TINY_COLOR_IO_IMPLEMENTATION
+#include "tiny-color-io.h"
+
+namespace {
+
+// Recomputes the payload checksum of a binary container so mutated headers
+// reach the loaders instead of stopping at the checksum test.
+void FixupChecksum(std::vector<char> *buf) {
+  tinycolorio::LUTBinaryHeader header;
+  if ((buf->size() < sizeof(header)) ||
+      (memcmp(buf->data(), "TCIOLUT", 8) != 0)) {
+    return;
+  }
+  memcpy(&header, buf->data(), sizeof(header));
+  if ((header.payload_offset > buf->size()) ||
+      (header.payload_size > (buf->size() - header.payload_offset))) {
+    return;
+  }
+  header.payload_checksum = tinycolorio::LUTBinaryChecksum(
+      buf->data() + header.payload_offset, size_t(header.payload_size));
+  memcpy(buf->data(), &header, sizeof(header));
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  std::vector<char> buf(data, data + size);
+  FixupChecksum(&buf);
+  const char *p = buf.data();
+
+  tinycolorio::LoadOptions options;
+  options.max_memory = 64 * 1024 * 1024;
+
+  std::string err;
+
+  tinycolorio::LUTInfo info;
+  tinycolorio::ProbeLUTMemory(p, size, &info, &err);
+
+  tinycolorio::LUT3Df lut3d;
+  tinycolorio::LoadSPI3DFromMemory(p, size, &lut3d, options, &err);
+  tinycolorio::LoadLUTBinaryFromMemory(p, size, &lut3d, options, &err);
+
+  tinycolorio::LUT1Df lut1d;
+  tinycolorio::LoadSPI3DFromMemory(p, size, &lut1d, options, &err);
+  tinycolorio::LoadLUTBinaryFromMemory(p, size, &lut1d, options, &err);
+
+  return 0;
+}
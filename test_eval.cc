@@ -0,0 +1,507 @@
+//
+// Conformance test of the ApplyBatch() kernel tiers(SIMDLevel) against the
+// per pixel kernels and a double precision reference, of
+// LUT3DIntegerEvaluator against the float evaluation and of the SSE2 half
+// conversion against the scalar one.
+//
+// $ make test_eval && ./test_eval
+//
+#define TINY_COLOR_IO_IMPLEMENTATION
+#include "tiny-color-io.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+using namespace tinycolorio;
+
+namespace {
+
+int g_failures = 0;
+
+const char *LevelName(SIMDLevel level) {
+  switch (level) {
+    case SIMDLevel::kScalar:
+      return "scalar";
+    case SIMDLevel::kSSE41:
+      return "SSE4.1";
+    case SIMDLevel::kAVX2:
+      return "AVX2";
+    case SIMDLevel::kAVX512:
+      return "AVX-512F";
+  }
+  return "?";
+}
+
+const char *LayoutName(LUT3DLayout layout) {
+  switch (layout) {
+    case LUT3DLayout::kInterleaved:
+      return "interleaved";
+    case LUT3DLayout::kPlanar:
+      return "planar";
+    case LUT3DLayout::kPaddedRGBA:
+      return "padded";
+    case LUT3DLayout::kBrickedRGBA:
+      return "bricked";
+  }
+  return "?";
+}
+
+void Check(bool cond, const char *what, SIMDLevel level, LUT3DLayout layout,
+           LUT3DInterpolation interpolation, size_t dim) {
+  if (!cond) {
+    printf("FAIL %s: %s %s %s %zu^3\n", what, LevelName(level),
+           LayoutName(layout),
+           (interpolation == LUT3DInterpolation::kTetrahedral) ? "tetrahedral"
+                                                              : "trilinear",
+           dim);
+    g_failures++;
+  }
+}
+
+uint32_t Random(uint32_t *state) {
+  (*state) = (*state) * 1664525u + 1013904223u;
+  return (*state) >> 8;
+}
+
+float RandomFloat(uint32_t *state, float lo, float hi) {
+  return lo + (hi - lo) * (float(Random(state)) / float(1u << 24));
+}
+
+LUT3Df MakeLUT(size_t x_dim, size_t y_dim, size_t z_dim, LUT3DLayout layout,
+               uint32_t seed) {
+  LUT3Df lut;
+  lut.create(x_dim, y_dim, z_dim, layout);
+  for (size_t z = 0; z < z_dim; z++) {
+    for (size_t y = 0; y < y_dim; y++) {
+      for (size_t x = 0; x < x_dim; x++) {
+        lut.set(x, y, z, RandomFloat(&seed, 0.0f, 1.0f),
+                RandomFloat(&seed, 0.0f, 1.0f), RandomFloat(&seed, 0.0f, 1.0f));
+      }
+    }
+  }
+  return lut;
+}
+
+// Random samples in and around [0, 1], cell corners, ties between the
+// components(tetrahedron boundaries) and special values.
+std::vector<float> MakeSamples(size_t dim, uint32_t seed) {
+  std::vector<float> rgb;
+  for (size_t i = 0; i < 1000; i++) {
+    rgb.push_back(RandomFloat(&seed, -0.1f, 1.1f));
+  }
+  for (size_t i = 0; i < dim; i++) {
+    const float v = float(i) / float(dim - 1);
+    const float w = RandomFloat(&seed, 0.0f, 1.0f);
+    const float samples[] = {v, v, v, v, v, w, w, v, v, v, w, w, w, v, w};
+    rgb.insert(rgb.end(), samples, samples + 15);
+  }
+  const float inf = std::numeric_limits<float>::infinity();
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float specials[] = {nan, 0.5f, 0.5f, inf, -inf, 0.5f, -0.0f, 1.0f,
+                            0.0f, 0.25f, nan, inf, 1.0f, 1.0f, 1.0f};
+  rgb.insert(rgb.end(), specials, specials + 15);
+  return rgb;
+}
+
+double Clamp01(float v) {
+  return (v > 0.0f) ? ((v < 1.0f) ? double(v) : 1.0) : 0.0;
+}
+
+// Reference interpolation in double precision.
+void EvalReference(const LUT3Df &lut, LUT3DInterpolation interpolation,
+                   const float rgb[3], double out[3]) {
+  const size_t dims[3] = {lut.x_dim(), lut.y_dim(), lut.z_dim()};
+  size_t i0[3];
+  double f[3];
+  for (int a = 0; a < 3; a++) {
+    const double p = Clamp01(rgb[a]) * double(dims[a] - 1);
+    i0[a] = std::min(size_t(p), dims[a] - 2);
+    f[a] = p - double(i0[a]);
+  }
+  auto corner = [&](int dx, int dy, int dz, int c) {
+    const size_t idx = lut.index(i0[0] + size_t(dx), i0[1] + size_t(dy),
+                                 i0[2] + size_t(dz));
+    return double(lut.data_[lut.offset(idx, size_t(c))]);
+  };
+
+  for (int c = 0; c < 3; c++) {
+    if (interpolation == LUT3DInterpolation::kTetrahedral) {
+      // Walk from (0, 0, 0) to (1, 1, 1) along the axes in the order of
+      // decreasing fraction.
+      int order[3] = {0, 1, 2};
+      std::sort(order, order + 3, [&](int a, int b) { return f[a] > f[b]; });
+      int d[3] = {0, 0, 0};
+      double prev = corner(0, 0, 0, c);
+      double v = prev;
+      for (int k = 0; k < 3; k++) {
+        d[order[k]] = 1;
+        const double next = corner(d[0], d[1], d[2], c);
+        v += (next - prev) * f[order[k]];
+        prev = next;
+      }
+      out[c] = v;
+    } else {
+      double v = 0.0;
+      for (int k = 0; k < 8; k++) {
+        const int dx = k & 1, dy = (k >> 1) & 1, dz = (k >> 2) & 1;
+        v += corner(dx, dy, dz, c) * (dx ? f[0] : 1.0 - f[0]) *
+             (dy ? f[1] : 1.0 - f[1]) * (dz ? f[2] : 1.0 - f[2]);
+      }
+      out[c] = v;
+    }
+  }
+}
+
+bool Equal(const std::vector<float> &a, const std::vector<float> &b) {
+  return (a.size() == b.size()) &&
+         (memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0);
+}
+
+void TestLUT(SIMDLevel level, const LUT3Df &lut,
+             LUT3DInterpolation interpolation,
+             const std::vector<float> &src, std::vector<float> *result) {
+  const LUT3DLayout layout = lut.layout();
+  const size_t dim = lut.x_dim();
+  const size_t count = src.size() / 3;
+  // FMA lerps round once per multiply-add.
+  const bool exact =
+      (level == SIMDLevel::kScalar) || (level == SIMDLevel::kSSE41);
+
+  std::vector<float> dst(src.size());
+  ApplyBatch(lut, src.data(), dst.data(), count, 3, 3, interpolation);
+
+  float max_diff = 0.0f;
+  double max_ref_diff = 0.0;
+  for (size_t i = 0; i < count; i++) {
+    float out[3];
+    if (interpolation == LUT3DInterpolation::kTetrahedral) {
+      EvalTetrahedral(lut, &src[3 * i], out);
+    } else {
+      EvalTrilinear(lut, &src[3 * i], out);
+    }
+    double ref[3];
+    EvalReference(lut, interpolation, &src[3 * i], ref);
+    for (size_t c = 0; c < 3; c++) {
+      max_diff = std::max(max_diff, std::fabs(dst[3 * i + c] - out[c]));
+      max_ref_diff = std::max(max_ref_diff,
+                              std::fabs(double(dst[3 * i + c]) - ref[c]));
+    }
+  }
+  Check(exact ? (max_diff == 0.0f) : (max_diff <= 1e-6f),
+        "differs from per pixel kernel", level, layout, interpolation, dim);
+  Check(max_ref_diff <= 1e-5, "differs from reference", level, layout,
+        interpolation, dim);
+
+  // RGBA in place: same RGB, alpha untouched.
+  std::vector<float> rgba(4 * count);
+  for (size_t i = 0; i < count; i++) {
+    memcpy(&rgba[4 * i], &src[3 * i], 3 * sizeof(float));
+    rgba[4 * i + 3] = float(i);
+  }
+  ApplyBatch(lut, rgba.data(), rgba.data(), count, 4, 4, interpolation);
+  bool rgba_ok = true;
+  for (size_t i = 0; i < count; i++) {
+    rgba_ok &= (memcmp(&rgba[4 * i], &dst[3 * i], 3 * sizeof(float)) == 0) &&
+               (rgba[4 * i + 3] == float(i));
+  }
+  Check(rgba_ok, "RGBA in place", level, layout, interpolation, dim);
+
+  // Planar.
+  std::vector<float> planes(src.size()), planar_dst(src.size());
+  for (size_t i = 0; i < count; i++) {
+    for (size_t c = 0; c < 3; c++) {
+      planes[c * count + i] = src[3 * i + c];
+    }
+  }
+  const float *const planar_src[3] = {&planes[0], &planes[count],
+                                      &planes[2 * count]};
+  float *const planar_out[3] = {&planar_dst[0], &planar_dst[count],
+                                &planar_dst[2 * count]};
+  ApplyBatchPlanar(lut, planar_src, planar_out, count, interpolation);
+  bool planar_ok = true;
+  for (size_t i = 0; i < count; i++) {
+    for (size_t c = 0; c < 3; c++) {
+      planar_ok &= (planar_dst[c * count + i] == dst[3 * i + c]);
+    }
+  }
+  Check(planar_ok, "planar", level, layout, interpolation, dim);
+
+  // Batches that end within a vector give the same result.
+  bool tail_ok = true;
+  for (size_t n = 1; n <= 33; n++) {
+    std::vector<float> part(3 * n);
+    ApplyBatch(lut, src.data(), part.data(), n, 3, 3, interpolation);
+    tail_ok &= (memcmp(part.data(), dst.data(), 3 * n * sizeof(float)) == 0);
+  }
+  Check(tail_ok, "tail", level, layout, interpolation, dim);
+
+  (*result) = dst;
+}
+
+void TestEvaluator(SIMDLevel level, size_t dim,
+                   LUT3DInterpolation interpolation,
+                   const std::vector<float> &src) {
+  LUT3DEvaluator evaluator;
+  evaluator.init(MakeLUT(dim, dim, dim, LUT3DLayout::kPaddedRGBA, 7));
+  evaluator.set_interpolation(interpolation);
+  const bool exact =
+      (level == SIMDLevel::kScalar) || (level == SIMDLevel::kSSE41);
+
+  const size_t count = src.size() / 3;
+  std::vector<float> dst(src.size());
+  ApplyBatch(evaluator, src.data(), dst.data(), count);
+  float max_diff = 0.0f;
+  for (size_t i = 0; i < count; i++) {
+    float out[3];
+    evaluator.eval(&src[3 * i], out);
+    for (size_t c = 0; c < 3; c++) {
+      max_diff = std::max(max_diff, std::fabs(dst[3 * i + c] - out[c]));
+    }
+  }
+  Check(exact ? (max_diff == 0.0f) : (max_diff <= 1e-6f), "evaluator", level,
+        LUT3DLayout::kPaddedRGBA, interpolation, dim);
+}
+
+// LUT3DIntegerEvaluator against rounding the float evaluation.
+void TestInteger(LUT3DInterpolation interpolation) {
+  const int bits[] = {8, 10, 12, 16};
+  const LUT3Df lut = MakeLUT(17, 9, 33, LUT3DLayout::kInterleaved, 11);
+  uint32_t seed = 5;
+  for (int in_bits : bits) {
+    for (int out_bits : bits) {
+      LUT3DIntegerEvaluator evaluator;
+      std::string err;
+      if (!evaluator.init(lut, in_bits, out_bits, &err)) {
+        printf("FAIL integer init: %s\n", err.c_str());
+        g_failures++;
+        continue;
+      }
+      evaluator.set_interpolation(interpolation);
+
+      const uint32_t max_in = (1u << in_bits) - 1;
+      const float max_out = float((1u << out_bits) - 1);
+      const size_t count = 4096;
+      std::vector<uint16_t> src(3 * count), dst(3 * count);
+      for (size_t i = 0; i < src.size(); i++) {
+        // Corners and edges first.
+        src[i] = uint16_t((i < 24) ? (((i / 3) >> (i % 3)) & 1) * max_in
+                                   : Random(&seed) % (max_in + 1));
+      }
+      if (!ApplyBatch(evaluator, src.data(), dst.data(), count)) {
+        printf("FAIL integer ApplyBatch %d -> %d bits\n", in_bits, out_bits);
+        g_failures++;
+        continue;
+      }
+
+      int max_diff = 0;
+      for (size_t i = 0; i < count; i++) {
+        float rgb[3], out[3];
+        for (size_t c = 0; c < 3; c++) {
+          rgb[c] = float(src[3 * i + c]) / float(max_in);
+        }
+        if (interpolation == LUT3DInterpolation::kTetrahedral) {
+          EvalTetrahedral(lut, rgb, out);
+        } else {
+          EvalTrilinear(lut, rgb, out);
+        }
+        for (size_t c = 0; c < 3; c++) {
+          const int expected = int(std::lround(out[c] * max_out));
+          max_diff = std::max(max_diff, std::abs(expected - dst[3 * i + c]));
+        }
+      }
+
+      // RGBA in place.
+      std::vector<uint16_t> rgba(4 * count);
+      for (size_t i = 0; i < count; i++) {
+        memcpy(&rgba[4 * i], &src[3 * i], 3 * sizeof(uint16_t));
+        rgba[4 * i + 3] = uint16_t(i);
+      }
+      bool rgba_ok =
+          ApplyBatch(evaluator, rgba.data(), rgba.data(), count, 4, 4);
+      for (size_t i = 0; i < count; i++) {
+        rgba_ok &=
+            (memcmp(&rgba[4 * i], &dst[3 * i], 3 * sizeof(uint16_t)) == 0) &&
+            (rgba[4 * i + 3] == uint16_t(i));
+      }
+
+      if ((max_diff > ((out_bits == 16) ? 2 : 1)) || !rgba_ok) {
+        printf("FAIL integer %d -> %d bits %s: max diff %d%s\n", in_bits,
+               out_bits,
+               (interpolation == LUT3DInterpolation::kTetrahedral)
+                   ? "tetrahedral"
+                   : "trilinear",
+               max_diff, rgba_ok ? "" : ", RGBA");
+        g_failures++;
+      }
+    }
+  }
+}
+
+// Evaluating an empty LUT(e.g. after a failed load) leaves `out` as is.
+template <typename View>
+bool LeavesOutput(const View &lut) {
+  const float rgb[3] = {0.5f, 0.5f, 0.5f};
+  float out[3] = {-1.0f, -1.0f, -1.0f};
+  EvalTrilinear(lut, rgb, out);
+  EvalTetrahedral(lut, rgb, out);
+  ApplyBatch(lut, rgb, out, 1);
+  ApplyBatch(lut, rgb, out, 1, 3, 3, LUT3DInterpolation::kTetrahedral);
+  return (out[0] == -1.0f) && (out[1] == -1.0f) && (out[2] == -1.0f);
+}
+
+void TestEmpty() {
+  const float data[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  bool ok =
+      LeavesOutput(LUT3DViewf(LUT3Df())) &&
+      LeavesOutput(LUT3DViewh(LUT3Dh())) &&
+      LeavesOutput(LUT3DViewu16(LUT3Du16())) &&
+      LeavesOutput(LUT3DViewf(data, 0, 1, 1, LUT3DLayout::kPaddedRGBA)) &&
+      LeavesOutput(LUT3DViewf(data, 1, 1, 0, LUT3DLayout::kInterleaved));
+
+  // Evaluator before init() and after init() with an empty LUT.
+  for (int i = 0; i < 2; i++) {
+    LUT3DEvaluator evaluator;
+    if (i == 1) {
+      evaluator.init(LUT3Df());
+      evaluator.set_interpolation(LUT3DInterpolation::kTetrahedral);
+    }
+    const float rgb[3] = {0.5f, 0.5f, 0.5f};
+    float out[3] = {-1.0f, -1.0f, -1.0f};
+    evaluator.eval(rgb, out);
+    ApplyBatch(evaluator, rgb, out, 1);
+    ok &= (out[0] == -1.0f) && (out[1] == -1.0f) && (out[2] == -1.0f);
+  }
+
+  if (!ok) {
+    printf("FAIL empty LUT\n");
+    g_failures++;
+  }
+}
+
+// uint8_t pixels are rejected unless the matching bit depth is 8.
+void TestIntegerBitDepths() {
+  const LUT3Df lut = MakeLUT(5, 5, 5, LUT3DLayout::kInterleaved, 3);
+  uint8_t src8[3] = {1, 2, 3}, dst8[3] = {0, 0, 0};
+  uint16_t src16[3] = {1, 2, 3}, dst16[3] = {0, 0, 0};
+
+  LUT3DIntegerEvaluator empty;
+  bool ok = !ApplyBatch(empty, src16, dst16, 1);
+
+  LUT3DIntegerEvaluator evaluator;
+  ok &= evaluator.init(lut, 10, 16);
+  ok &= !ApplyBatch(evaluator, src8, dst16, 1);
+  ok &= !ApplyBatch(evaluator, src16, dst8, 1);
+  ok &= ApplyBatch(evaluator, src16, dst16, 1);
+
+  ok &= evaluator.init(lut, 8, 8);
+  ok &= ApplyBatch(evaluator, src8, dst8, 1);
+  ok &= ApplyBatch(evaluator, src16, dst8, 1);
+
+  if (!ok) {
+    printf("FAIL integer bit depth checks\n");
+    g_failures++;
+  }
+}
+
+#if defined(TINYCOLORIO_USE_SSE2)
+// SSE2 HalfToFloat4() against the scalar conversion for every half(including
+// signalling NaNs, which both quiet).
+void TestHalf() {
+  for (uint32_t h = 0; h < 0x10000; h += 4) {
+    alignas(16) uint16_t bits[8] = {uint16_t(h), uint16_t(h + 1),
+                                    uint16_t(h + 2), uint16_t(h + 3)};
+    alignas(16) float out[4];
+    _mm_store_ps(out, HalfToFloat4(_mm_load_si128(
+                          reinterpret_cast<const __m128i *>(bits))));
+    for (int i = 0; i < 4; i++) {
+      const float expected = HalfToFloat(bits[i]);
+      if (memcmp(&out[i], &expected, sizeof(float)) != 0) {
+        printf("FAIL half 0x%04x\n", unsigned(bits[i]));
+        g_failures++;
+        return;
+      }
+    }
+  }
+}
+#endif
+
+}  // namespace
+
+int main() {
+  const SIMDLevel levels[] = {SIMDLevel::kScalar, SIMDLevel::kSSE41,
+                              SIMDLevel::kAVX2, SIMDLevel::kAVX512};
+  const LUT3DLayout layouts[] = {
+      LUT3DLayout::kInterleaved, LUT3DLayout::kPlanar,
+      LUT3DLayout::kPaddedRGBA, LUT3DLayout::kBrickedRGBA};
+  const LUT3DInterpolation interpolations[] = {
+      LUT3DInterpolation::kTrilinear, LUT3DInterpolation::kTetrahedral};
+  const size_t dims[] = {2, 5, 17, 33};
+
+  // AVX2 results in test order.
+  std::vector<std::vector<float>> avx2_results;
+
+  for (SIMDLevel level : levels) {
+    SetMaxSIMDLevel(level);
+    if (GetSIMDLevel() != level) {
+      printf("%s: not supported, skipped\n", LevelName(level));
+      continue;
+    }
+
+    const int failures = g_failures;
+    size_t test = 0;
+    for (size_t dim : dims) {
+      const std::vector<float> src = MakeSamples(dim, uint32_t(dim));
+      for (LUT3DLayout layout : layouts) {
+        // Non cubic LUTs exercise per axis strides.
+        const LUT3Df lut =
+            MakeLUT(dim, dim + 1, dim + 2, layout, uint32_t(dim) * 31);
+        for (LUT3DInterpolation interpolation : interpolations) {
+          std::vector<float> result;
+          TestLUT(level, lut, interpolation, src, &result);
+          // AVX-512F performs the operations of the AVX2 kernel.
+          if (level == SIMDLevel::kAVX2) {
+            avx2_results.push_back(result);
+          } else if ((level == SIMDLevel::kAVX512) &&
+                     (test < avx2_results.size())) {
+            Check(Equal(result, avx2_results[test]), "differs from AVX2",
+                  level, layout, interpolation, dim);
+          }
+          test++;
+        }
+      }
+      if (dim >= 17) {
+        for (LUT3DInterpolation interpolation : interpolations) {
+          TestEvaluator(level, dim, interpolation, src);
+        }
+      }
+    }
+    printf("%s: %s\n", LevelName(level),
+           (g_failures == failures) ? "ok" : "FAILED");
+  }
+
+  SetMaxSIMDLevel(SIMDLevel::kAVX512);
+
+  const int failures = g_failures;
+  for (LUT3DInterpolation interpolation : interpolations) {
+    TestInteger(interpolation);
+  }
+  TestIntegerBitDepths();
+  printf("integer: %s\n", (g_failures == failures) ? "ok" : "FAILED");
+
+  const int empty_failures = g_failures;
+  TestEmpty();
+  printf("empty: %s\n", (g_failures == empty_failures) ? "ok" : "FAILED");
+
+#if defined(TINYCOLORIO_USE_SSE2)
+  const int half_failures = g_failures;
+  TestHalf();
+  printf("half: %s\n", (g_failures == half_failures) ? "ok" : "FAILED");
+#endif
+
+  return (g_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,406 @@
+//
+// Regression tests of the LUT loaders.
+//
+// $ make test_load && ./test_load
+//
+#define TINY_COLOR_IO_IMPLEMENTATION
+#include "tiny-color-io.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace tinycolorio;
+
+namespace {
+
+int g_failures = 0;
+
+void Check(bool cond, const char *what) {
+  if (!cond) {
+    printf("FAIL %s\n", what);
+    g_failures++;
+  }
+}
+
+// Binary container with a valid checksum for `header` and `num_values`
+// floats of payload.
+std::vector<char> MakeLUTBinary(LUTBinaryHeader header, size_t num_values) {
+  std::vector<float> payload(num_values);
+  for (size_t i = 0; i < num_values; i++) {
+    payload[i] = float(i) / float(num_values);
+  }
+
+  memcpy(header.magic, "TCIOLUT", 8);
+  header.version = kLUTBinaryVersion;
+  header.header_size = uint32_t(sizeof(LUTBinaryHeader));
+  header.element_type = uint32_t(LUTElementType::kFloat32);
+  header.payload_offset = sizeof(LUTBinaryHeader);
+  header.payload_size = num_values * sizeof(float);
+  header.payload_checksum =
+      LUTBinaryChecksum(payload.data(), size_t(header.payload_size));
+
+  std::vector<char> data(sizeof(LUTBinaryHeader) + header.payload_size);
+  memcpy(data.data(), &header, sizeof(header));
+  memcpy(data.data() + sizeof(header), payload.data(),
+         size_t(header.payload_size));
+  return data;
+}
+
+LUTBinaryHeader MakeHeader(uint32_t num_dims, uint32_t components,
+                           uint64_t x, uint64_t y, uint64_t z) {
+  LUTBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  header.num_dims = num_dims;
+  header.components = components;
+  header.layout_flags = kLUTLayoutInterleaved;
+  header.dims[0] = x;
+  header.dims[1] = y;
+  header.dims[2] = z;
+  header.x_range[1] = 1.0f;
+  return header;
+}
+
+bool WriteFile(const std::string &filename, const std::string &content) {
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  const bool ok =
+      fwrite(content.data(), 1, content.size(), fp) == content.size();
+  return (fclose(fp) == 0) && ok;
+}
+
+std::string MakeSPI3D(int size, bool blue_fastest = true) {
+  std::string s = "SPILUT 1.0\n3 3\n" + std::to_string(size) + " " +
+                  std::to_string(size) + " " + std::to_string(size) + "\n";
+  for (int a = 0; a < size; a++) {
+    for (int j = 0; j < size; j++) {
+      for (int b = 0; b < size; b++) {
+        const int i = blue_fastest ? a : b;
+        const int k = blue_fastest ? b : a;
+        const double d = double(size - 1);
+        char line[128];
+        snprintf(line, sizeof(line), "%d %d %d %f %f %f\n", i, j, k,
+                 double(i) / d, double(j) / d, double(k) / d);
+        s += line;
+      }
+    }
+  }
+  return s;
+}
+
+std::string MakeSPI1D(int length, int components) {
+  std::string s = "Version 1\nFrom 0.0 1.0\nLength " +
+                  std::to_string(length) + "\nComponents " +
+                  std::to_string(components) + "\n{\n";
+  for (int i = 0; i < length; i++) {
+    for (int c = 0; c < components; c++) {
+      s += " " + std::to_string(double(i) / double(length - 1));
+    }
+    s += "\n";
+  }
+  return s + "}\n";
+}
+
+void TestBinaryDims() {
+  std::string err;
+
+  // 1D header whose payload covers dims[0] * dims[1] values.
+  {
+    const std::vector<char> data =
+        MakeLUTBinary(MakeHeader(1, 1, 4, 64, 1), 4 * 64);
+    LUT1Df lut;
+    Check(!LoadLUTBinaryFromMemory(data.data(), data.size(), &lut, &err),
+          "binary 1D with dims[1] != 1 is rejected");
+    LUT1DViewf view;
+    Check(!ViewLUTBinaryFromMemory(data.data(), data.size(), &view, &err),
+          "binary 1D view with dims[1] != 1 is rejected");
+  }
+
+  // 3D header with a component count other than RGB.
+  {
+    const std::vector<char> data =
+        MakeLUTBinary(MakeHeader(3, 1, 4, 4, 12), 4 * 4 * 12);
+    LUT3Df lut;
+    Check(!LoadLUTBinaryFromMemory(data.data(), data.size(), &lut, &err),
+          "binary 3D with 1 component is rejected");
+    LUT3DViewf view;
+    Check(!ViewLUTBinaryFromMemory(data.data(), data.size(), &view, &err),
+          "binary 3D view with 1 component is rejected");
+  }
+
+  // Consistent headers still load.
+  {
+    const std::vector<char> data =
+        MakeLUTBinary(MakeHeader(1, 3, 16, 1, 1), 3 * 16);
+    LUT1Df lut;
+    Check(LoadLUTBinaryFromMemory(data.data(), data.size(), &lut, &err) &&
+              (lut.length() == 16) && (lut.components_ == 3),
+          "binary 1D loads");
+  }
+  {
+    const std::vector<char> data =
+        MakeLUTBinary(MakeHeader(3, 3, 2, 3, 4), 3 * 2 * 3 * 4);
+    LUT3Df lut;
+    Check(LoadLUTBinaryFromMemory(data.data(), data.size(), &lut, &err) &&
+              (lut.x_dim() == 2) && (lut.y_dim() == 3) && (lut.z_dim() == 4),
+          "binary 3D loads");
+  }
+}
+
+void TestSPI1D() {
+  std::string err;
+  for (int components = 1; components <= 3; components += 2) {
+    const std::string spi1d = MakeSPI1D(5, components);
+    LUT1Df lut;
+    bool ok = LoadSPI3DFromMemory(spi1d.data(), spi1d.size(), &lut,
+                                  LoadOptions(), &err) &&
+              (lut.length() == 5) && (lut.components_ == size_t(components));
+    for (size_t i = 0; ok && (i < lut.data_.size()); i++) {
+      ok = (lut.data_[i] == float(i / size_t(components)) / 4.0f);
+    }
+    Check(ok, "spi1d loads");
+  }
+
+  const std::string two = MakeSPI1D(5, 2);
+  LUT1Df lut;
+  Check(!LoadSPI3DFromMemory(two.data(), two.size(), &lut, LoadOptions(),
+                             &err) &&
+            (err.find("Components") != std::string::npos),
+        "spi1d with 2 components is rejected");
+
+  // Truncated body and missing closing brace.
+  const std::string full = MakeSPI1D(5, 1);
+  const std::string truncated = full.substr(0, full.find("0.75"));
+  Check(!LoadSPI3DFromMemory(truncated.data(), truncated.size(), &lut,
+                             LoadOptions(), &err),
+        "truncated spi1d is rejected");
+  const std::string unclosed = full.substr(0, full.rfind('}'));
+  Check(!LoadSPI3DFromMemory(unclosed.data(), unclosed.size(), &lut,
+                             LoadOptions(), &err),
+        "unclosed spi1d is rejected");
+}
+
+// The blue-fastest staging buffer counts against max_memory.
+void TestStagingMemory() {
+  // 17^3 float RGB is 59 KB; with staging and `written` flags 123 KB.
+  LoadOptions options;
+  options.max_memory = 100 * 1000;
+  std::string err;
+
+  const std::string red_fastest = MakeSPI3D(17, false);
+  LUT3Df lut;
+  Check(LoadSPI3DFromMemory(red_fastest.data(), red_fastest.size(), &lut,
+                            options, &err),
+        "red-fastest spi3d fits max_memory");
+
+  const std::string blue_fastest = MakeSPI3D(17, true);
+  Check(!LoadSPI3DFromMemory(blue_fastest.data(), blue_fastest.size(), &lut,
+                             options, &err) &&
+            (err.find("max_memory") != std::string::npos),
+        "blue-fastest spi3d staging exceeds max_memory");
+}
+
+// The last entry is replaced with a copy of the first, so the duplicate
+// lands in another chunk when the body is split. 33^3 entries is a ~1.3 MB
+// body, which the parser splits into several chunks.
+void TestDuplicateEntry() {
+  std::string spi3d = MakeSPI3D(33);
+  size_t body = 0;
+  for (int i = 0; i < 3; i++) {  // skip the 3 header lines
+    body = spi3d.find('\n', body) + 1;
+  }
+  const std::string first =
+      spi3d.substr(body, spi3d.find('\n', body) + 1 - body);
+  const size_t last = spi3d.rfind('\n', spi3d.size() - 2) + 1;
+  spi3d = spi3d.substr(0, last) + first;
+
+  for (uint32_t num_threads = 1; num_threads <= 4; num_threads *= 4) {
+    LoadOptions options;
+    options.num_threads = num_threads;
+    LUT3Df lut;
+    std::string err;
+    Check(!LoadSPI3DFromMemory(spi3d.data(), spi3d.size(), &lut, options,
+                               &err) &&
+              (err.find("Duplicate") != std::string::npos),
+          "duplicate spi3d entry is rejected");
+  }
+
+  // Make sure the body really is split.
+  size_t num_chunks = 0;
+  LoadOptions options;
+  options.executor = [&](size_t num_tasks,
+                         const std::function<void(size_t)> &task) {
+    num_chunks = num_tasks;
+    for (size_t i = 0; i < num_tasks; i++) {
+      task(i);
+    }
+  };
+  LUT3Df lut;
+  std::string err;
+  Check(!LoadSPI3DFromMemory(spi3d.data(), spi3d.size(), &lut, options,
+                             &err) &&
+            (num_chunks > 1),
+        "duplicate spi3d entry crosses chunks");
+}
+
+void TestQuantizeRange() {
+  const std::string spi3d = MakeSPI3D(5);
+  const float kNaN = std::numeric_limits<float>::quiet_NaN();
+  const float ranges[][2] = {{1.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, kNaN},
+                             {-3e38f, 3e38f}};
+  std::string err;
+  LUT3Du16 lut16;
+  for (const auto &range : ranges) {
+    LoadOptions options;
+    options.quantize_range[0] = range[0];
+    options.quantize_range[1] = range[1];
+    Check(!LoadSPI3DFromMemory(spi3d.data(), spi3d.size(), &lut16, options,
+                               &err),
+          "invalid quantize_range is rejected");
+  }
+  Check(LoadSPI3DFromMemory(spi3d.data(), spi3d.size(), &lut16,
+                            LoadOptions(), &err),
+        "default quantize_range loads");
+
+  LUT3Df lut;
+  Check(LoadSPI3DFromMemory(spi3d.data(), spi3d.size(), &lut, LoadOptions(),
+                            &err),
+        "spi3d loads");
+  Check(ConvertLUT3D(lut, &lut16, LUT3DLayout::kPaddedRGBA, &err),
+        "ConvertLUT3D");
+
+  const float bad[] = {kNaN, std::numeric_limits<float>::infinity()};
+  for (float v : bad) {
+    LUT3Df copy = lut;
+    copy.data_[7] = v;
+    Check(!ConvertLUT3D(copy, &lut16, LUT3DLayout::kPaddedRGBA, &err),
+          "ConvertLUT3D rejects non-finite values");
+  }
+
+  // Finite values whose range overflows float.
+  LUT3Df wide = lut;
+  wide.data_[0] = -3e38f;
+  wide.data_[1] = 3e38f;
+  Check(!ConvertLUT3D(wide, &lut16, LUT3DLayout::kPaddedRGBA, &err),
+        "ConvertLUT3D rejects an unrepresentable range");
+}
+
+bool IsCancelledError(const std::string &err) {
+  return err.find("cancelled") != std::string::npos;
+}
+
+void TestCancel() {
+  std::atomic<bool> cancel(true);
+  LoadOptions options;
+  options.cancel = &cancel;
+  std::string err;
+
+  const std::string spi1d = MakeSPI1D(16, 1);
+  LUT1Df lut1d;
+  Check(!LoadSPI3DFromMemory(spi1d.data(), spi1d.size(), &lut1d, options,
+                             &err) &&
+            IsCancelledError(err),
+        "spi1d load is cancelled");
+
+  const std::vector<char> data =
+      MakeLUTBinary(MakeHeader(1, 1, 16, 1, 1), 16);
+  Check(!LoadLUTBinaryFromMemory(data.data(), data.size(), &lut1d, options,
+                                 &err) &&
+            IsCancelledError(err),
+        "binary load is cancelled");
+}
+
+// A throwing progress callback fails the task instead of leaving it pending.
+void TestAsyncException() {
+  const std::string filename = "test_load_async.spi3d";
+  Check(WriteFile(filename, MakeSPI3D(17)), "write spi3d");
+
+  for (uint32_t num_threads = 1; num_threads <= 2; num_threads++) {
+    LoadOptions options;
+    options.num_threads = num_threads;
+    options.progress = [](float) { throw std::runtime_error("boom"); };
+
+    LUTLoadTask<LUT3Df> task = LoadLUT3DFromFileAsync(filename, options);
+    LUT3Df lut;
+    std::string err;
+    Check(!task.get(&lut, &err) && (err.find("boom") != std::string::npos),
+          "async load reports the exception");
+  }
+
+  remove(filename.c_str());
+}
+
+// More files than LoadLUTFiles() keeps open at once, with a missing and an
+// oversized file in the middle.
+void TestBatch() {
+  const size_t kNumFiles = 150;
+  const std::string spi3d = MakeSPI3D(5);
+  const std::string spi1d = MakeSPI1D(16, 3);
+
+  std::vector<std::string> filenames;
+  for (size_t i = 0; i < kNumFiles; i++) {
+    std::string filename = "test_load_batch_" + std::to_string(i);
+    if (i == 70) {
+      filename += ".missing";
+    } else if (i == 71) {
+      filename += ".spi3d";
+      Check(WriteFile(filename, MakeSPI3D(33)), "write large spi3d");
+    } else if ((i % 2) == 0) {
+      filename += ".spi3d";
+      Check(WriteFile(filename, spi3d), "write spi3d");
+    } else {
+      filename += ".spi1d";
+      Check(WriteFile(filename, spi1d), "write spi1d");
+    }
+    filenames.push_back(filename);
+  }
+
+  // The 33^3 file is ~1.4 MB of text; the rest fit.
+  LoadOptions options;
+  options.max_memory = 1024 * 1024;
+
+  std::vector<LUTBatchResult> results;
+  Check(!LoadLUTFiles(filenames, &results, options), "batch with errors");
+  Check(results.size() == kNumFiles, "batch result count");
+  for (size_t i = 0; i < results.size(); i++) {
+    const LUTBatchResult &r = results[i];
+    if (i == 70) {
+      Check(!r.ok, "missing file fails");
+    } else if (i == 71) {
+      Check(!r.ok && (r.err.find("max_memory") != std::string::npos),
+            "oversized file is rejected");
+    } else if ((i % 2) == 0) {
+      Check(r.ok && (r.num_dims == 3) && (r.lut3d.x_dim() == 5),
+            "batch spi3d");
+    } else {
+      Check(r.ok && (r.num_dims == 1) && (r.lut1d.length() == 16),
+            "batch spi1d");
+    }
+  }
+
+  for (const std::string &filename : filenames) {
+    remove(filename.c_str());
+  }
+}
+
+}  // namespace
+
+int main() {
+  TestBinaryDims();
+  TestSPI1D();
+  TestStagingMemory();
+  TestDuplicateEntry();
+  TestQuantizeRange();
+  TestCancel();
+  TestAsyncException();
+  TestBatch();
+
+  printf("%s\n", (g_failures == 0) ? "ok" : "FAILED");
+  return (g_failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -8,12 +8,37 @@
 int main(int argc, char **argv)
 {
   if (argc < 2) {
-    std::cerr << "Requires input.spi3d" << std::endl;
+    std::cerr << "Requires input.spi3d or input.spi1d" << std::endl;
     return EXIT_FAILURE;
   } 
 
   std::string filename = std::string(argv[1]);
 
+  if ((filename.size() > 6) &&
+      (filename.compare(filename.size() - 6, 6, ".spi1d") == 0)) {
+    tinycolorio::LUT1Df lut1d;
+    std::string err;
+    if (!tinycolorio::LoadSPI3DFromFile(filename, &lut1d, &err)) {
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "length " << lut1d.length() << std::endl;
+    std::cout << "components " << lut1d.components_ << std::endl;
+
+    for (size_t i = 0; i < lut1d.length(); i++) {
+      std::cout << "[" << i << "] =";
+      for (size_t c = 0; c < lut1d.components_; c++) {
+        float v = 0.0f;
+        lut1d.get(i, c, v);
+        std::cout << " " << v;
+      }
+      std::cout << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+  }
+
   tinycolorio::LUT3Df lut;
   std::string err;
   if (!tinycolorio::LoadSPI3DFromFile(filename, &lut, &err)) {
@@ -1,25 +1,284 @@
 #ifndef TINY_COLOR_IO_H_
 #define TINY_COLOR_IO_H_
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <array>
 
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
 namespace tinycolorio {
 
+///
+/// STL allocator returning `Alignment` byte aligned memory.
+///
+template <typename T, size_t Alignment = 16>
+struct AlignedAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t(-1) / sizeof(T))) {
+      throw std::bad_alloc();
+    }
+#if defined(_WIN32)
+    void *p = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+    void *p = nullptr;
+    if (posix_memalign(&p, Alignment, n * sizeof(T)) != 0) {
+      p = nullptr;
+    }
+#endif
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+};
+
+template <typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &,
+                const AlignedAllocator<U, Alignment> &) {
+  return false;
+}
+
+// Tables of at least this size are backed by huge pages where possible.
+constexpr size_t kLUTHugePageSize = 2 * 1024 * 1024;
+
+///
+/// Default allocator of LUT storage.
+///
+/// - 64 byte(cache line) aligned.
+/// - `resize()` leaves new values default-initialized(i.e. uninitialized
+///   for arithmetic types and `half`) instead of zero-filling a table the
+///   loader overwrites anyway.
+/// - Tables of kLUTHugePageSize or more are 2 MiB aligned and marked with
+///   madvise(MADV_HUGEPAGE) on Linux, so lookups into 65^3 and larger LUTs
+///   need far fewer TLB entries.
+///
 template <typename T>
+struct LUTAllocator {
+  using value_type = T;
+
+  template <typename U>
+  struct rebind {
+    using other = LUTAllocator<U>;
+  };
+
+  LUTAllocator() = default;
+
+  template <typename U>
+  LUTAllocator(const LUTAllocator<U> &) {}
+
+  T *allocate(size_t n) {
+    if (n > (size_t(-1) / sizeof(T))) {
+      throw std::bad_alloc();
+    }
+    const size_t bytes = n * sizeof(T);
+    const bool huge = (bytes >= kLUTHugePageSize);
+#if defined(_WIN32)
+    void *p = _aligned_malloc(bytes, huge ? kLUTHugePageSize : 64);
+#else
+    void *p = nullptr;
+    if (posix_memalign(&p, huge ? kLUTHugePageSize : 64, bytes) != 0) {
+      p = nullptr;
+    }
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (p && huge) {
+      // Only a hint. Fails harmlessly where THP is disabled.
+      madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#endif
+#endif
+    if (!p) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T *>(p);
+  }
+
+  void deallocate(T *p, size_t) {
+#if defined(_WIN32)
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+
+  // Default-initialization for `resize(n)` and `vector(n)`.
+  template <typename U>
+  void construct(U *p) {
+    ::new (static_cast<void *>(p)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U *p, Args &&... args) {
+    ::new (static_cast<void *>(p)) U(std::forward<Args>(args)...);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(const LUTAllocator<T> &, const LUTAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const LUTAllocator<T> &, const LUTAllocator<U> &) {
+  return false;
+}
+
+///
+/// Converts IEEE 754 binary32 to binary16 bits(round to nearest even).
+///
+inline uint16_t FloatToHalf(float f) {
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+  const uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+
+  uint32_t h;
+  if (x >= 0x47800000u) {
+    // >= 65536: Inf or NaN(quiet, upper payload bits kept).
+    h = (x > 0x7f800000u) ? (0x7e00u | ((x >> 13) & 0x3ffu)) : 0x7c00u;
+  } else if (x < 0x38800000u) {
+    // < 2^-14: subnormal or zero. Let the FPU round the mantissa.
+    const float magic = 0.5f;  // (127 - 14 + 10) << 23
+    float v;
+    memcpy(&v, &x, sizeof(v));
+    v += magic;
+    memcpy(&h, &v, sizeof(h));
+    h -= 0x3f000000u;
+  } else {
+    const uint32_t mant_odd = (x >> 13) & 1u;
+    x += 0xc8000fffu + mant_odd;  // rebias exponent and round
+    h = x >> 13;
+  }
+  return uint16_t(h | (sign >> 16));
+}
+
+///
+/// Converts IEEE 754 binary16 bits to binary32.
+///
+inline float HalfToFloat(uint16_t h) {
+  const uint32_t kShiftedExp = 0x7c00u << 13;
+  uint32_t o = uint32_t(h & 0x7fffu) << 13;
+  const uint32_t exp = o & kShiftedExp;
+  o += (127 - 15) << 23;
+
+  float f;
+  if (exp == kShiftedExp) {
+    o += (128 - 16) << 23;  // Inf/NaN
+    if (o & 0x7fffffu) {
+      o |= 0x400000u;  // quiet NaN
+    }
+    memcpy(&f, &o, sizeof(f));
+  } else if (exp == 0) {
+    o += 1 << 23;  // zero/subnormal: renormalize
+    memcpy(&f, &o, sizeof(f));
+    f -= 6.103515625e-05f;  // 2^-14
+  } else {
+    memcpy(&f, &o, sizeof(f));
+  }
+
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  u |= uint32_t(h & 0x8000u) << 16;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+///
+/// IEEE 754 binary16 storage type. Arithmetic goes through float.
+///
+struct half {
+  uint16_t bits{0};
+
+  half() = default;
+  half(float v) : bits(FloatToHalf(v)) {}
+
+  operator float() const { return HalfToFloat(bits); }
+};
+
+static_assert(sizeof(half) == 2, "half must be 2 bytes");
+
+template <typename T, typename Allocator = LUTAllocator<T>>
 class LUT1D {
  public:
-  LUT1D() : x_range_({0.0f, 1.0f}), version_(1), components_(0) {}
+  using allocator_type = Allocator;
 
-  ~LUT1D() = default;
+  LUT1D() : version_(1), x_range_({{T(0), T(1)}}), components_(0) {}
 
-  void create(size_t length, size_t components, std::array<T, 2> x_range) {
+  ///
+  /// Values are zero unless `initialize` is false, in which case the caller
+  /// must write every value(loaders do).
+  ///
+  void create(size_t length, size_t components, std::array<T, 2> x_range,
+              bool initialize = true) {
     components_ = components;
+    data_.clear();
     data_.resize(length * components);
+    if (initialize) {
+      std::fill(data_.begin(), data_.end(), T(0));
+    }
+    x_range_ = x_range;
+  }
+
+  ///
+  /// Takes over `data`(length * components values) without copying.
+  ///
+  /// @return false when `components` is 0 or does not divide the size of
+  /// `data`. This LUT is left unchanged then.
+  ///
+  bool adopt(std::vector<T, Allocator> &&data, size_t components,
+             std::array<T, 2> x_range) {
+    if ((components == 0) || ((data.size() % components) != 0)) {
+      return false;
+    }
+    components_ = components;
+    data_ = std::move(data);
     x_range_ = x_range;
+    return true;
   }
 
   void set(size_t idx, size_t comp, const T val) {
@@ -31,175 +290,5965 @@ class LUT1D {
   bool get(size_t idx, size_t comp, T &val) const {
     if ((idx * components_ + comp) < data_.size()) {
       val = data_[idx * components_ + comp];
+      return true;
     }
+    return false;
   }
 
-  size_t length() { return data_.size() / components_; }
+  size_t length() const { return components_ ? (data_.size() / components_) : 0; }
 
   uint32_t version_{1};
   std::array<T, 2> x_range_;
   size_t components_{1};
 
-  std::vector<T> data_; // sz = components_ * length;
+  std::vector<T, Allocator> data_; // sz = components_ * length;
 };
 
+///
+/// Non-owning 1D LUT over a LUT1D, a mapped binary file or a caller buffer.
+/// The memory must outlive the view.
+///
 template <typename T>
-class LUT3D {
+class LUT1DView {
+ public:
+  LUT1DView() = default;
+
+  LUT1DView(const T *data, size_t length, size_t components,
+            std::array<T, 2> x_range)
+      : x_range_(x_range),
+        components_(components),
+        length_(length),
+        data_(data) {}
+
+  template <typename Allocator>
+  LUT1DView(const LUT1D<T, Allocator> &lut)
+      : x_range_(lut.x_range_),
+        components_(lut.components_),
+        length_(lut.length()),
+        data_(lut.data_.data()) {}
+
+  bool get(size_t idx, size_t comp, T &val) const {
+    if ((idx < length_) && (comp < components_)) {
+      val = data_[idx * components_ + comp];
+      return true;
+    }
+    return false;
+  }
+
+  size_t length() const { return length_; }
+
+  std::array<T, 2> x_range_{{T(0), T(1)}};
+  size_t components_{0};
+  size_t length_{0};
+  const T *data_{nullptr};  // length_ * components_ values
+};
+
+///
+/// Memory layout of `LUT3D::data_`. x varies fastest in every layout.
+///
+enum class LUT3DLayout : uint32_t {
+  kInterleaved = 0,  // RGBRGB...
+  kPlanar = 1,       // RRR...GGG...BBB...
+  kPaddedRGBA = 2,   // RGB_RGB_...(4th value is padding)
+  kBrickedRGBA = 3,  // kPaddedRGBA entries in 4x4x4 bricks(see LUT3D::index)
+};
+
+// Edge length of a kBrickedRGBA brick.
+constexpr size_t kLUT3DBrickSize = 4;
+
+///
+/// 3D LUT interpolation method.
+///
+enum class LUT3DInterpolation : uint32_t {
+  kTrilinear = 0,    // 8 cell corners, 7 lerps per component
+  kTetrahedral = 1,  // 4 cell corners(the tetrahedron containing the sample)
+};
+
+///
+/// Dimensions and memory layout shared by LUT3D and LUT3DView.
+///
+class LUT3DShape {
  public:
-  LUT3D() : x_dim_(0), y_dim_(0), z_dim_(0) {}
+  LUT3DLayout layout() const { return layout_; }
+
+  ///
+  /// Distance between two consecutive entries in the values.
+  ///
+  size_t entry_stride() const { return entry_stride_; }
+
+  ///
+  /// Distance between R, G and B of an entry in the values.
+  ///
+  size_t component_stride() const { return component_stride_; }
+
+  ///
+  /// Entry index of (x, y, z). x_dim_ * y_dim_ * z + x_dim_ * y + x, except
+  /// for kBrickedRGBA which stores the entries of each 4x4x4 brick(x
+  /// fastest) contiguously, so a trilinear cell mostly stays within 1 KiB
+  /// (float) instead of spanning two rows and two z slices.
+  ///
+  size_t index(size_t x, size_t y, size_t z) const {
+    if (layout_ != LUT3DLayout::kBrickedRGBA) {
+      return (x_dim_ * y_dim_) * z + x_dim_ * y + x;
+    }
+    const size_t B = kLUT3DBrickSize;
+    const size_t brick =
+        ((z / B) * bricks_y_ + (y / B)) * bricks_x_ + (x / B);
+    return brick * (B * B * B) + ((z % B) * B + (y % B)) * B + (x % B);
+  }
+
+  ///
+  /// Number of entries, including the padding of partial bricks.
+  ///
+  size_t num_entries() const {
+    if (layout_ != LUT3DLayout::kBrickedRGBA) {
+      return x_dim_ * y_dim_ * z_dim_;
+    }
+    const size_t B = kLUT3DBrickSize;
+    return bricks_x_ * bricks_y_ * ((z_dim_ + B - 1) / B) * (B * B * B);
+  }
+
+  ///
+  /// Number of values(3 or 4 per entry).
+  ///
+  size_t num_values() const {
+    return ((entry_stride_ == 4) ? 4 : 3) * num_entries();
+  }
+
+  ///
+  /// Index of component `c` of entry `idx`(see `index()`) in the values.
+  ///
+  size_t offset(size_t idx, size_t c) const {
+    return idx * entry_stride_ + c * component_stride_;
+  }
+
+  size_t x_dim() const { return x_dim_; }
 
-  ~LUT3D() {}
+  size_t y_dim() const { return y_dim_; }
 
-  void create(size_t x_dim, size_t y_dim, size_t z_dim) {
-    size_t len = x_dim * y_dim * z_dim;
-    data_.resize(3 * len);
+  size_t z_dim() const { return z_dim_; }
 
+  size_t x_dim_{0};
+  size_t y_dim_{0};
+  size_t z_dim_{0};
+
+ protected:
+  void set_shape(size_t x_dim, size_t y_dim, size_t z_dim,
+                 LUT3DLayout layout) {
     x_dim_ = x_dim;
     y_dim_ = y_dim;
     z_dim_ = z_dim;
+    layout_ = layout;
+    bricks_x_ = (x_dim_ + kLUT3DBrickSize - 1) / kLUT3DBrickSize;
+    bricks_y_ = (y_dim_ + kLUT3DBrickSize - 1) / kLUT3DBrickSize;
+    if (layout == LUT3DLayout::kPlanar) {
+      entry_stride_ = 1;
+      component_stride_ = x_dim * y_dim * z_dim;
+    } else if ((layout == LUT3DLayout::kPaddedRGBA) ||
+               (layout == LUT3DLayout::kBrickedRGBA)) {
+      entry_stride_ = 4;
+      component_stride_ = 1;
+    } else {
+      layout_ = LUT3DLayout::kInterleaved;
+      entry_stride_ = 3;
+      component_stride_ = 1;
+    }
+  }
+
+  LUT3DLayout layout_{LUT3DLayout::kInterleaved};
+  size_t entry_stride_{3};
+  size_t component_stride_{1};
+  size_t bricks_x_{0};  // kBrickedRGBA only
+  size_t bricks_y_{0};
+};
+
+template <typename T, typename Allocator = LUTAllocator<T>>
+class LUT3D : public LUT3DShape {
+ public:
+  using allocator_type = Allocator;
+
+  LUT3D() = default;
+
+  ///
+  /// Values(and padding) are zero unless `initialize` is false, in which
+  /// case the caller must write every value including padding(loaders do).
+  ///
+  void create(size_t x_dim, size_t y_dim, size_t z_dim,
+              LUT3DLayout layout = LUT3DLayout::kInterleaved,
+              bool initialize = true) {
+    set_shape(x_dim, y_dim, z_dim, layout);
+
+    data_.clear();
+    data_.resize(num_values());
+    if (initialize) {
+      std::fill(data_.begin(), data_.end(), T(0));
+    }
+  }
+
+  ///
+  /// Takes over `data`(num_values() values in `layout`) without copying.
+  ///
+  /// @return false when the size of `data` does not match. This LUT is left
+  /// unchanged then.
+  ///
+  bool adopt(std::vector<T, Allocator> &&data, size_t x_dim, size_t y_dim,
+             size_t z_dim, LUT3DLayout layout = LUT3DLayout::kInterleaved) {
+    // Dimensions whose value count(bricks included) could overflow never
+    // match.
+    size_t n = 4;
+    const size_t dims[3] = {x_dim, y_dim, z_dim};
+    for (size_t d : dims) {
+      d += kLUT3DBrickSize;
+      if ((d < kLUT3DBrickSize) || (n > (size_t(-1) / d))) {
+        return false;
+      }
+      n *= d;
+    }
+
+    LUT3D<T, Allocator> shape;
+    shape.set_shape(x_dim, y_dim, z_dim, layout);
+    if (data.size() != shape.num_values()) {
+      return false;
+    }
+    set_shape(x_dim, y_dim, z_dim, layout);
+    data_ = std::move(data);
+    return true;
+  }
+
+  ///
+  /// Converts `data_` to `layout`.
+  ///
+  void convert(LUT3DLayout layout) {
+    if (layout == layout_) {
+      return;
+    }
+
+    LUT3D<T, Allocator> dst;
+    dst.create(x_dim_, y_dim_, z_dim_, layout);
+    for (size_t z = 0; z < z_dim_; z++) {
+      for (size_t y = 0; y < y_dim_; y++) {
+        for (size_t x = 0; x < x_dim_; x++) {
+          const size_t s = index(x, y, z);
+          const size_t d = dst.index(x, y, z);
+          for (size_t c = 0; c < 3; c++) {
+            dst.data_[dst.offset(d, c)] = data_[offset(s, c)];
+          }
+        }
+      }
+    }
+    dst.scale_ = scale_;
+    dst.offset_ = offset_;
+    (*this) = std::move(dst);
   }
 
   void set(size_t x, size_t y, size_t z, const T val[3]) {
     if ((x < x_dim_) && (y < y_dim_) && (z < z_dim_)) {
-      size_t idx = (x_dim_ * y_dim_) * z + x_dim_ * y + x;
-      data_[3 * idx + 0] = val[0];
-      data_[3 * idx + 1] = val[1];
-      data_[3 * idx + 2] = val[2];
+      size_t idx = index(x, y, z);
+      data_[offset(idx, 0)] = val[0];
+      data_[offset(idx, 1)] = val[1];
+      data_[offset(idx, 2)] = val[2];
     }
   }
 
   void set(size_t x, size_t y, size_t z, const T r_val, const T g_val,
            const T b_val) {
     if ((x < x_dim_) && (y < y_dim_) && (z < z_dim_)) {
-      size_t idx = (x_dim_ * y_dim_) * z + x_dim_ * y + x;
-      data_[3 * idx + 0] = r_val;
-      data_[3 * idx + 1] = g_val;
-      data_[3 * idx + 2] = b_val;
+      size_t idx = index(x, y, z);
+      data_[offset(idx, 0)] = r_val;
+      data_[offset(idx, 1)] = g_val;
+      data_[offset(idx, 2)] = b_val;
     }
   }
 
   void get(size_t x, size_t y, size_t z, T val[3]) const {
     if ((x < x_dim_) && (y < y_dim_) && (z < z_dim_)) {
-      size_t idx = (x_dim_ * y_dim_) * z + x_dim_ * y + x;
-      val[0] = data_[3 * idx + 0];
-      val[1] = data_[3 * idx + 1];
-      val[2] = data_[3 * idx + 2];
+      size_t idx = index(x, y, z);
+      val[0] = data_[offset(idx, 0)];
+      val[1] = data_[offset(idx, 1)];
+      val[2] = data_[offset(idx, 2)];
     }
   }
 
-  size_t x_dim() { return x_dim_; }
+  // See `layout_`. LUTAllocator aligns to 64 bytes, so kPaddedRGBA float
+  // entries never straddle cache lines.
+  std::vector<T, Allocator> data_;
+
+  // Dequantization of integer `T`: value = data_[i] * scale_ + offset_.
+  // Unused for floating point `T`.
+  float scale_{std::is_integral<T>::value
+                   ? (1.0f / float(std::numeric_limits<T>::max()))
+                   : 1.0f};
+  float offset_{0.0f};
+};
+
+///
+/// Non-owning 3D LUT over a LUT3D, a mapped binary file or a caller buffer
+/// (any layout, no alignment requirement). The memory must outlive the
+/// view. Accepted by every evaluator.
+///
+template <typename T>
+class LUT3DView : public LUT3DShape {
+ public:
+  LUT3DView() = default;
+
+  ///
+  /// View of `num_values()` values in `layout` at `data`.
+  ///
+  LUT3DView(const T *data, size_t x_dim, size_t y_dim, size_t z_dim,
+            LUT3DLayout layout = LUT3DLayout::kInterleaved)
+      : data_(data) {
+    set_shape(x_dim, y_dim, z_dim, layout);
+  }
 
-  size_t y_dim() { return y_dim_; }
+  template <typename Allocator>
+  LUT3DView(const LUT3D<T, Allocator> &lut)
+      : LUT3DShape(lut),
+        data_(lut.data_.data()),
+        scale_(lut.scale_),
+        offset_(lut.offset_) {}
 
-  size_t z_dim() { return z_dim_; }
+  void get(size_t x, size_t y, size_t z, T val[3]) const {
+    if ((x < x_dim_) && (y < y_dim_) && (z < z_dim_)) {
+      size_t idx = index(x, y, z);
+      val[0] = data_[offset(idx, 0)];
+      val[1] = data_[offset(idx, 1)];
+      val[2] = data_[offset(idx, 2)];
+    }
+  }
 
-  size_t x_dim_;
-  size_t y_dim_;
-  size_t z_dim_;
+  const T *data_{nullptr};
 
-  std::vector<T> data_;  // RGB
+  // See LUT3D::scale_.
+  float scale_{std::is_integral<T>::value
+                   ? (1.0f / float(std::numeric_limits<T>::max()))
+                   : 1.0f};
+  float offset_{0.0f};
 };
 
 using LUT1Df = LUT1D<float>;
 using LUT3Df = LUT3D<float>;
+using LUT3Du16 = LUT3D<uint16_t>;  // quantized, see `LUT3D::scale_`
+using LUT1Dh = LUT1D<half>;
+using LUT3Dh = LUT3D<half>;
 
-///
-/// Loads SPI1D LUT data(ASCII)
-///
-/// @param[in] filename spi1d LUT filename.
-/// @param[out] lut 1D LUT table.
-/// @param[out] err Error message(when failed to load a LUT).
-/// @return true upon succes.
-///
-bool LoadSPI3DFromFile(const std::string &filename, LUT1Df *lut,
-                       std::string *err = nullptr);
+using LUT1DViewf = LUT1DView<float>;
+using LUT1DViewh = LUT1DView<half>;
+using LUT3DViewf = LUT3DView<float>;
+using LUT3DViewu16 = LUT3DView<uint16_t>;
+using LUT3DViewh = LUT3DView<half>;
 
 ///
-/// Loads SPI3D LUT data(ASCII)
-///
-/// @param[in] filename spi3d LUT filename.
-/// @param[out] lut 3D LUT table.
-/// @param[out] err Error message(when failed to load a LUT).
-/// @return true upon succes.
+/// Cell-major copy of a 3D LUT for latency bound lookups. Each of the
+/// (x_dim - 1) * (y_dim - 1) * (z_dim - 1) cells stores its 8 corners
+/// contiguously, so a trilinear lookup reads one cell(96 bytes for float,
+/// 48 bytes for half, at most two cache lines) instead of 8 entries spread
+/// over two rows and two z slices. Takes about 8x the memory of `LUT3D`.
 ///
-bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
-                       std::string *err = nullptr);
+template <typename T>
+class LUT3DCells {
+ public:
+  // Values per cell: R of the 8 corners, then G, then B. Corners are
+  // ordered (x0,y0,z0), (x1,y0,z0), (x0,y1,z0), ... (x1,y1,z1).
+  static constexpr size_t kCellSize = 24;
 
-}  // namespace tinycolorio
+  void build(const LUT3DView<T> &lut) {
+    x_dim_ = lut.x_dim_;
+    y_dim_ = lut.y_dim_;
+    z_dim_ = lut.z_dim_;
 
-#endif  // TINY_COLOR_IO_H_
+    data_.clear();
+    data_.resize(kCellSize * num_cells());
+    if (data_.empty()) {
+      return;
+    }
 
-#ifdef TINY_COLOR_IO_IMPLEMENTATION
+    size_t i = 0;
+    for (size_t z = 0; z < z_cells(); z++) {
+      for (size_t y = 0; y < y_cells(); y++) {
+        for (size_t x = 0; x < x_cells(); x++) {
+          T *d = &data_[kCellSize * i++];
+          for (size_t k = 0; k < 8; k++) {
+            // Single sample axes reuse the sample.
+            const size_t cx = std::min(x + (k & 1), x_dim_ - 1);
+            const size_t cy = std::min(y + ((k >> 1) & 1), y_dim_ - 1);
+            const size_t cz = std::min(z + ((k >> 2) & 1), z_dim_ - 1);
+            const size_t idx = lut.index(cx, cy, cz);
+            for (size_t c = 0; c < 3; c++) {
+              d[8 * c + k] = lut.data_[lut.offset(idx, c)];
+            }
+          }
+        }
+      }
+    }
+  }
 
-#include <algorithm>
-#include <cstdio>
-#include <fstream>
-#include <iostream>
+  size_t x_cells() const { return (x_dim_ > 1) ? (x_dim_ - 1) : x_dim_; }
 
-namespace tinycolorio {
+  size_t y_cells() const { return (y_dim_ > 1) ? (y_dim_ - 1) : y_dim_; }
 
-bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
-                       std::string *err) {
-  std::ifstream ifs(filename);
+  size_t z_cells() const { return (z_dim_ > 1) ? (z_dim_ - 1) : z_dim_; }
 
-  if (!ifs) {
-    if (err) {
-      (*err) = "Failed to open file : " + filename;
+  size_t num_cells() const { return x_cells() * y_cells() * z_cells(); }
+
+  // Dimensions of the source LUT.
+  size_t x_dim_{0};
+  size_t y_dim_{0};
+  size_t z_dim_{0};
+
+  // `kCellSize` values per cell, x fastest. 64 byte aligned.
+  std::vector<T, LUTAllocator<T>> data_;
+};
+
+template <typename T>
+constexpr size_t LUT3DCells<T>::kCellSize;
+
+using LUT3DCellsf = LUT3DCells<float>;
+using LUT3DCellsh = LUT3DCells<half>;
+
+///
+/// 3D LUT with compile time dimensions(`FixedLUT3D<float, 33>` or
+/// `FixedLUT3D<float, 17, 33, 65>`) for float or half `T`. Entries are
+/// padded RGBA, x fastest, so strides, corner offsets and the (dim - 1)
+/// scales are all constants.
+///
+template <typename T, size_t X, size_t Y = X, size_t Z = X>
+class FixedLUT3D {
+  static_assert((X > 0) && (Y > 0) && (Z > 0), "Invalid LUT dimensions");
+
+ public:
+  static constexpr size_t kStrideX = 4;
+  static constexpr size_t kStrideY = kStrideX * X;
+  static constexpr size_t kStrideZ = kStrideY * Y;
+
+  FixedLUT3D() : data_(kStrideZ * Z, T(0)) {}
+
+  ///
+  /// Copies `lut`(any layout).
+  ///
+  /// @return false when the dimensions of `lut` differ.
+  ///
+  bool assign(const LUT3DView<T> &lut) {
+    if ((lut.x_dim_ != X) || (lut.y_dim_ != Y) || (lut.z_dim_ != Z)) {
+      return false;
     }
-    return false;
+    for (size_t z = 0; z < Z; z++) {
+      for (size_t y = 0; y < Y; y++) {
+        for (size_t x = 0; x < X; x++) {
+          const size_t idx = lut.index(x, y, z);
+          T *d = &data_[index(x, y, z)];
+          for (size_t c = 0; c < 3; c++) {
+            d[c] = lut.data_[lut.offset(idx, c)];
+          }
+        }
+      }
+    }
+    return true;
   }
 
-  // header
-  std::string line;
-  std::getline(ifs, line);
+  static constexpr size_t index(size_t x, size_t y, size_t z) {
+    return kStrideZ * z + kStrideY * y + kStrideX * x;
+  }
 
-  std::string buf;
+  void set(size_t x, size_t y, size_t z, const T val[3]) {
+    if ((x < X) && (y < Y) && (z < Z)) {
+      T *d = &data_[index(x, y, z)];
+      d[0] = val[0];
+      d[1] = val[1];
+      d[2] = val[2];
+    }
+  }
 
-  // lower string.
-  for (auto c : line) {
-    buf.push_back(static_cast<char>(std::tolower(c)));
+  void get(size_t x, size_t y, size_t z, T val[3]) const {
+    if ((x < X) && (y < Y) && (z < Z)) {
+      const T *d = &data_[index(x, y, z)];
+      val[0] = d[0];
+      val[1] = d[1];
+      val[2] = d[2];
+    }
   }
-  // std::transform(line.begin(), line.end(), buf.begin(), std::tolower);
 
-  if (buf.find("spilut") == std::string::npos) {
-    if (err) {
-      (*err) = "Not a SPILUT format. header = " + line;
+  ///
+  /// Trilinear interpolation. Same result as EvalTrilinear() of the
+  /// equivalent LUT3D.
+  ///
+  void eval(const float rgb[3], float out[3]) const {
+    float fx, fy, fz;
+    const T *d = data_.data() + index(coord(rgb[0], X, &fx),
+                                      coord(rgb[1], Y, &fy),
+                                      coord(rgb[2], Z, &fz));
+    constexpr size_t dx = (X > 1) ? kStrideX : 0;
+    constexpr size_t dy = (Y > 1) ? kStrideY : 0;
+    constexpr size_t dz = (Z > 1) ? kStrideZ : 0;
+    for (size_t c = 0; c < 3; c++) {
+      const float v00 = lerp(float(d[c]), float(d[dx + c]), fx);
+      const float v10 = lerp(float(d[dy + c]), float(d[dy + dx + c]), fx);
+      const float v01 = lerp(float(d[dz + c]), float(d[dz + dx + c]), fx);
+      const float v11 =
+          lerp(float(d[dz + dy + c]), float(d[dz + dy + dx + c]), fx);
+      out[c] = lerp(lerp(v00, v10, fy), lerp(v01, v11, fy), fz);
     }
-    return false;
   }
 
-  // ignore 2nd line(assuming 3 3)
-  std::getline(ifs, line);
+  // `kStrideZ * Z` values.
+  std::vector<T, LUTAllocator<T>> data_;
 
-  // lut size
-  std::getline(ifs, line);
+ private:
+  static float lerp(float a, float b, float t) { return a + (b - a) * t; }
 
-  int x_size = 0, y_size = 0, z_size = 0;
-  if (3 != sscanf(line.c_str(), "%d %d %d", &x_size, &y_size, &z_size)) {
-    if (err) {
-      (*err) = "Error while reading lut size";
+  // Lower sample index of `v`(clamped to [0, 1]) and the fraction.
+  static size_t coord(float v, size_t dim, float *f) {
+    if (!(v > 0.0f)) {
+      v = 0.0f;  // also handles NaN
+    } else if (v > 1.0f) {
+      v = 1.0f;
     }
-    return false;
+    if (dim < 2) {
+      (*f) = 0.0f;
+      return 0;
+    }
+    const float p = v * float(dim - 1);
+    size_t i = size_t(p);
+    if (i > (dim - 2)) {
+      i = dim - 2;
+    }
+    (*f) = p - float(i);
+    return i;
   }
+};
 
-  lut->create(size_t(x_size), size_t(y_size), size_t(z_size));
+template <typename T, size_t X, size_t Y, size_t Z>
+constexpr size_t FixedLUT3D<T, X, Y, Z>::kStrideX;
+template <typename T, size_t X, size_t Y, size_t Z>
+constexpr size_t FixedLUT3D<T, X, Y, Z>::kStrideY;
+template <typename T, size_t X, size_t Y, size_t Z>
+constexpr size_t FixedLUT3D<T, X, Y, Z>::kStrideZ;
+
+///
+/// Quantizes float 3D LUT to 16 bits. The value range of `src` is mapped to
+/// [0, 65535] and recorded in `dst->scale_` and `dst->offset_`.
+/// kPaddedRGBA(4x16 bits, 8 bytes per entry) lets the evaluator fetch each
+/// corner with one 64-bit load.
+///
+/// @param[in] src Float 3D LUT.
+/// @param[out] dst 16-bit 3D LUT.
+/// @param[in] layout Layout of `dst`.
+/// @param[out] err Error message.
+/// @return false when `src` has a non-finite value or its range cannot be
+/// represented.
+///
+bool ConvertLUT3D(const LUT3Df &src, LUT3Du16 *dst,
+                  LUT3DLayout layout = LUT3DLayout::kPaddedRGBA,
+                  std::string *err = nullptr);
 
-  int read_count = x_size * y_size * z_size;
+///
+/// Trilinear interpolation of 3D LUT.
+/// `rgb` is clamped to [0, 1] and indexes x(r), y(g) and z(b).
+/// kPaddedRGBA and kBrickedRGBA LUTs use one vector load per corner when SSE2
+/// is available.
+///
+/// @param[in] lut 3D LUT or view(any layout).
+/// @param[in] rgb Input color.
+/// @param[out] out Interpolated color(not written for an empty LUT).
+///
+void EvalTrilinear(const LUT3DViewf &lut, const float rgb[3], float out[3]);
 
-  while (ifs.good() && read_count > 0) {
-    std::getline(ifs, line);
+void EvalTrilinear(const LUT3DViewu16 &lut, const float rgb[3],
+                   float out[3]);
 
-    int x_idx = 0, y_idx = 0, z_idx = 0;
-    float r_value = 0.0f, g_value = 0.0f, b_value = 0.0f;
+///
+/// Half float LUTs are converted with F16C when the CPU supports it.
+///
+void EvalTrilinear(const LUT3DViewh &lut, const float rgb[3], float out[3]);
 
-    if (sscanf(line.c_str(), "%d %d %d %f %f %f", &x_idx, &y_idx, &z_idx,
-               &r_value, &g_value, &b_value) == 6) {
-      lut->set(size_t(x_idx), size_t(y_idx), size_t(z_idx), r_value, g_value,
-               b_value);
+inline void EvalTrilinear(const LUT3Df &lut, const float rgb[3],
+                          float out[3]) {
+  EvalTrilinear(LUT3DViewf(lut), rgb, out);
+}
+
+inline void EvalTrilinear(const LUT3Du16 &lut, const float rgb[3],
+                          float out[3]) {
+  EvalTrilinear(LUT3DViewu16(lut), rgb, out);
+}
+
+inline void EvalTrilinear(const LUT3Dh &lut, const float rgb[3],
+                          float out[3]) {
+  EvalTrilinear(LUT3DViewh(lut), rgb, out);
+}
+
+///
+/// Tetrahedral interpolation of 3D LUT. The cell is split into 6
+/// tetrahedra along its (0, 0, 0) - (1, 1, 1) diagonal and the 4 corners of
+/// the one containing `rgb` are blended, so half the corners of
+/// EvalTrilinear() are read. Exact on the diagonal(neutral axis) and what
+/// most grading tools use.
+///
+/// @param[in] lut 3D LUT or view(any layout).
+/// @param[in] rgb Input color.
+/// @param[out] out Interpolated color(not written for an empty LUT).
+///
+void EvalTetrahedral(const LUT3DViewf &lut, const float rgb[3], float out[3]);
+
+void EvalTetrahedral(const LUT3DViewu16 &lut, const float rgb[3],
+                     float out[3]);
+
+void EvalTetrahedral(const LUT3DViewh &lut, const float rgb[3], float out[3]);
+
+inline void EvalTetrahedral(const LUT3Df &lut, const float rgb[3],
+                            float out[3]) {
+  EvalTetrahedral(LUT3DViewf(lut), rgb, out);
+}
+
+inline void EvalTetrahedral(const LUT3Du16 &lut, const float rgb[3],
+                            float out[3]) {
+  EvalTetrahedral(LUT3DViewu16(lut), rgb, out);
+}
+
+inline void EvalTetrahedral(const LUT3Dh &lut, const float rgb[3],
+                            float out[3]) {
+  EvalTetrahedral(LUT3DViewh(lut), rgb, out);
+}
+
+///
+/// Trilinear interpolation of a cell-major 3D LUT. Same result as
+/// evaluating the source LUT up to rounding(blends z, then y, then x).
+///
+void EvalTrilinear(const LUT3DCellsf &cells, const float rgb[3],
+                   float out[3]);
+
+void EvalTrilinear(const LUT3DCellsh &cells, const float rgb[3],
+                   float out[3]);
+
+///
+/// Evaluates a float 3D LUT with a kernel specialized for its size when it
+/// is one of the common cube sizes(17, 33 or 65), where strides and corner
+/// offsets are compile time constants. Other sizes use EvalTrilinear().
+/// Results are identical to EvalTrilinear() of a kPaddedRGBA LUT, or to
+/// EvalTetrahedral() after set_interpolation(kTetrahedral).
+///
+class LUT3DEvaluator {
+ public:
+  LUT3DEvaluator() = default;
+  LUT3DEvaluator(const LUT3DEvaluator &other) { (*this) = other; }
+  LUT3DEvaluator(LUT3DEvaluator &&) = default;
+  LUT3DEvaluator &operator=(LUT3DEvaluator &&) = default;
+
+  LUT3DEvaluator &operator=(const LUT3DEvaluator &other) {
+    if (this != &other) {
+      lut_ = other.lut_;
+      view_ = other.owns() ? LUT3DViewf(lut_) : other.view_;
+      func_ = other.func_;
+      fixed_size_ = other.fixed_size_;
+      interpolation_ = other.interpolation_;
     }
+    return *this;
   }
 
-  return true;
+  ///
+  /// Copies `lut`(as kPaddedRGBA) and selects the kernel.
+  ///
+  void init(const LUT3Df &lut);
+
+  ///
+  /// Takes over `lut`. Only a LUT that is not kPaddedRGBA is copied(to
+  /// convert it).
+  ///
+  void init(LUT3Df &&lut);
+
+  ///
+  /// Evaluates a kPaddedRGBA view in place(e.g. a mapped binary file, which
+  /// must outlive the evaluator). Other layouts are copied.
+  ///
+  void init(const LUT3DViewf &lut);
+
+  ///
+  /// `out` is not written before init() or for an empty LUT(e.g. one that
+  /// failed to load).
+  ///
+  void eval(const float rgb[3], float out[3]) const {
+    func_(view_, rgb, out);
+  }
+
+  ///
+  /// Cube size served by a specialized kernel, 0 for the generic path.
+  ///
+  size_t fixed_size() const { return fixed_size_; }
+
+  ///
+  /// Trilinear by default. Can be changed before or after init().
+  ///
+  void set_interpolation(LUT3DInterpolation interpolation) {
+    interpolation_ = interpolation;
+    select();
+  }
+
+  LUT3DInterpolation interpolation() const { return interpolation_; }
+
+  ///
+  /// The evaluated(kPaddedRGBA) LUT.
+  ///
+  const LUT3DViewf &view() const { return view_; }
+
+ private:
+  using EvalFunc = void (*)(const LUT3DViewf &, const float *, float *);
+
+  // Before init() or after init() with an empty LUT. `out` is left as is.
+  static void EvalEmpty(const LUT3DViewf &, const float *, float *) {}
+
+  static void EvalGeneric(const LUT3DViewf &lut, const float *rgb,
+                          float *out) {
+    EvalTrilinear(lut, rgb, out);
+  }
+
+  static void EvalGenericTetrahedral(const LUT3DViewf &lut, const float *rgb,
+                                     float *out) {
+    EvalTetrahedral(lut, rgb, out);
+  }
+
+  bool owns() const {
+    return !lut_.data_.empty() && (view_.data_ == lut_.data_.data());
+  }
+
+  // Selects `func_` for `view_`.
+  void select();
+
+  LUT3Df lut_;  // Empty when `view_` refers to external memory.
+  LUT3DViewf view_;
+  EvalFunc func_{EvalEmpty};
+  size_t fixed_size_{0};
+  LUT3DInterpolation interpolation_{LUT3DInterpolation::kTrilinear};
+};
+
+///
+/// Evaluates `count` interleaved pixels, with the same result as calling
+/// EvalTrilinear()/EvalTetrahedral()(or LUT3DEvaluator::eval()) for each.
+/// The kernel is selected once for the LUT layout, size and CPU instead of
+/// per pixel. float LUTs(except bricked layout) are evaluated 16, 8 or 4
+/// pixels at a time with AVX-512F, AVX2 + FMA or SSE4.1 when the CPU supports
+/// it(see GetSIMDLevel()). The AVX-512F and AVX2 kernels use fused
+/// multiply-add, so their result may differ from the per pixel evaluation in
+/// the last bit.
+///
+/// @param[in] lut 3D LUT, view, cells or evaluator.
+/// @param[in] src Input pixels. The first 3 floats of a pixel are RGB.
+/// @param[out] dst Output pixels. Only RGB is written(alpha of RGBA pixels is
+/// left as is). Can be `src` for in place evaluation.
+/// @param[in] count The number of pixels.
+/// @param[in] src_stride Distance between input pixels in floats(3 for RGB,
+/// 4 for RGBA).
+/// @param[in] dst_stride Distance between output pixels in floats.
+/// @param[in] interpolation Interpolation method. Cells are trilinear only
+/// and an evaluator uses its own method.
+///
+void ApplyBatch(const LUT3DViewf &lut, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3,
+                LUT3DInterpolation interpolation =
+                    LUT3DInterpolation::kTrilinear);
+
+void ApplyBatch(const LUT3DViewu16 &lut, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3,
+                LUT3DInterpolation interpolation =
+                    LUT3DInterpolation::kTrilinear);
+
+void ApplyBatch(const LUT3DViewh &lut, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3,
+                LUT3DInterpolation interpolation =
+                    LUT3DInterpolation::kTrilinear);
+
+void ApplyBatch(const LUT3DCellsf &cells, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3);
+
+void ApplyBatch(const LUT3DCellsh &cells, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3);
+
+void ApplyBatch(const LUT3DEvaluator &evaluator, const float *src, float *dst,
+                size_t count, size_t src_stride = 3, size_t dst_stride = 3);
+
+///
+/// Planar version of ApplyBatch(). `src[c]` and `dst[c]` are the R, G and B
+/// planes of `count` pixels. `dst` planes can be the `src` planes.
+///
+void ApplyBatchPlanar(const LUT3DViewf &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation =
+                          LUT3DInterpolation::kTrilinear);
+
+void ApplyBatchPlanar(const LUT3DViewu16 &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation =
+                          LUT3DInterpolation::kTrilinear);
+
+void ApplyBatchPlanar(const LUT3DViewh &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation =
+                          LUT3DInterpolation::kTrilinear);
+
+void ApplyBatchPlanar(const LUT3DCellsf &cells, const float *const src[3],
+                      float *const dst[3], size_t count);
+
+void ApplyBatchPlanar(const LUT3DCellsh &cells, const float *const src[3],
+                      float *const dst[3], size_t count);
+
+void ApplyBatchPlanar(const LUT3DEvaluator &evaluator,
+                      const float *const src[3], float *const dst[3],
+                      size_t count);
+
+///
+/// Instruction set tiers of the ApplyBatch()/ApplyBatchPlanar() kernels.
+///
+enum class SIMDLevel : uint32_t {
+  kScalar = 0,  // per pixel kernels(always with TINY_COLOR_IO_NO_SIMD)
+  kSSE41 = 1,   // 4 pixels at a time
+  kAVX2 = 2,    // 8 pixels at a time, AVX2 + FMA
+  kAVX512 = 3,  // 16 pixels at a time, AVX-512F
+};
+
+///
+/// Limits the batch kernels to `level` and below, e.g. to compare tiers in
+/// tests and benchmarks. The default(kAVX512) uses the best tier the CPU
+/// supports. Affects batches started afterwards on any thread.
+///
+/// @return The previous limit.
+///
+SIMDLevel SetMaxSIMDLevel(SIMDLevel level);
+
+///
+/// Tier used by ApplyBatch()/ApplyBatchPlanar() on this CPU under the current
+/// limit.
+///
+SIMDLevel GetSIMDLevel();
+
+///
+/// Evaluates a 3D LUT for integer pixels of 8 to 16 bits per component(8-bit
+/// images, 10/12-bit video, 16-bit PNG) without converting them to float.
+/// init() precomputes a (cell offset, 16-bit weight) table per axis indexed by
+/// the input code value, and quantizes the LUT to 16-bit padded RGBA entries
+/// holding the output code with (16 - out_bits) fraction bits. Lerps are
+/// integer multiply-adds at full precision, rounded once to the output code.
+///
+/// Input code v maps to v / (2^in_bits - 1) in [0, 1]. LUT values in [0, 1]
+/// map to output codes [0, 2^out_bits - 1](values outside are clamped).
+/// Results are within one code value(two for 16-bit output) of rounding
+/// EvalTrilinear() or EvalTetrahedral() of the float LUT. The axis tables take
+/// 8 bytes per code value(1.5 MiB for 16-bit input).
+///
+class LUT3DIntegerEvaluator {
+ public:
+  static constexpr uint32_t kWeightBits = 16;
+
+  ///
+  /// Quantizes `lut` and builds the axis tables. init() must succeed before
+  /// evaluation.
+  ///
+  /// @param[in] lut 3D LUT or view(any layout, copied).
+  /// @param[in] in_bits Bits per input component(8 to 16).
+  /// @param[in] out_bits Bits per output component(8 to 16).
+  /// @param[out] err Error message.
+  /// @return false for an empty LUT or bits out of range.
+  ///
+  bool init(const LUT3DViewf &lut, int in_bits, int out_bits,
+            std::string *err = nullptr);
+
+  ///
+  /// Trilinear by default. Can be changed before or after init().
+  ///
+  void set_interpolation(LUT3DInterpolation interpolation) {
+    interpolation_ = interpolation;
+  }
+
+  LUT3DInterpolation interpolation() const { return interpolation_; }
+
+  int in_bits() const { return in_bits_; }
+
+  int out_bits() const { return out_bits_; }
+
+  ///
+  /// Evaluates input codes `rgb`(codes above 2^in_bits - 1 are clamped).
+  ///
+  void eval(const uint16_t rgb[3], uint16_t out[3]) const {
+    if (interpolation_ == LUT3DInterpolation::kTetrahedral) {
+      eval_tetrahedral(rgb, out);
+    } else {
+      eval_trilinear(rgb, out);
+    }
+  }
+
+  void eval_trilinear(const uint16_t rgb[3], uint16_t out[3]) const {
+    const AxisStep &x = axis_[0][std::min(rgb[0], max_code_)];
+    const AxisStep &y = axis_[1][std::min(rgb[1], max_code_)];
+    const AxisStep &z = axis_[2][std::min(rgb[2], max_code_)];
+    const uint16_t *d = data_.data() + x.offset + y.offset + z.offset;
+    const size_t dx = step_[0];
+    const size_t dy = step_[1];
+    const size_t dz = step_[2];
+    // x lerps have kWeightBits fraction bits, y and z lerps add theirs(64
+    // bits) and output() rounds the sum once.
+    const uint32_t wx = x.weight;
+    const uint64_t wy = y.weight;
+    const uint64_t wz = z.weight;
+    for (size_t c = 0; c < 3; c++) {
+      const uint64_t v00 = lerp(d[c], d[dx + c], wx);
+      const uint64_t v10 = lerp(d[dy + c], d[dy + dx + c], wx);
+      const uint64_t v01 = lerp(d[dz + c], d[dz + dx + c], wx);
+      const uint64_t v11 = lerp(d[dz + dy + c], d[dz + dy + dx + c], wx);
+      const uint64_t v0 = v00 * (kOne - wy) + v10 * wy;
+      const uint64_t v1 = v01 * (kOne - wy) + v11 * wy;
+      const uint64_t v = v0 * (kOne - wz) + v1 * wz;
+      out[c] = output(v, 3 * kWeightBits);
+    }
+  }
+
+  void eval_tetrahedral(const uint16_t rgb[3], uint16_t out[3]) const {
+    const AxisStep &x = axis_[0][std::min(rgb[0], max_code_)];
+    const AxisStep &y = axis_[1][std::min(rgb[1], max_code_)];
+    const AxisStep &z = axis_[2][std::min(rgb[2], max_code_)];
+    const uint16_t *d = data_.data() + x.offset + y.offset + z.offset;
+    const uint32_t fx = x.weight;
+    const uint32_t fy = y.weight;
+    const uint32_t fz = z.weight;
+
+    // Same tetrahedron as EvalTetrahedral(): b steps along the first axis,
+    // c along all axes but the last one.
+    const size_t xy = (fx > fy);
+    const size_t yz = (fy > fz);
+    const size_t zx = (fz >= fx);
+    const size_t b = ((xy & (zx ^ 1)) * step_[0]) +
+                     (((xy ^ 1) & yz) * step_[1]) +
+                     ((zx & (yz ^ 1)) * step_[2]);
+    const size_t e = step_[0] + step_[1] + step_[2];
+    const size_t c = e - (((xy ^ 1) & zx) * step_[0]) -
+                     (((yz ^ 1) & xy) * step_[1]) -
+                     (((zx ^ 1) & yz) * step_[2]);
+
+    const uint32_t lo = std::min(fx, fy);
+    const uint32_t hi = std::max(fx, fy);
+    const uint32_t f0 = std::max(hi, fz);
+    const uint32_t f1 = std::max(lo, std::min(hi, fz));
+    const uint32_t f2 = std::min(lo, fz);
+    // Barycentric weights sum to kOne, so the sum fits 32 bits.
+    const uint32_t w0 = kOne - f0;
+    const uint32_t wb = f0 - f1;
+    const uint32_t wc = f1 - f2;
+    for (size_t i = 0; i < 3; i++) {
+      const uint32_t v =
+          d[i] * w0 + d[b + i] * wb + d[c + i] * wc + d[e + i] * f2;
+      out[i] = output(v, kWeightBits);
+    }
+  }
+
+ private:
+  struct AxisStep {
+    uint32_t offset;  // of the lower sample, in values
+    uint32_t weight;  // of the upper sample, [0, kOne]
+  };
+
+  static constexpr uint32_t kOne = 1u << kWeightBits;
+
+  // a * (1 - w) + b * w with kWeightBits fraction bits(fits 32 bits).
+  static uint32_t lerp(uint32_t a, uint32_t b, uint32_t w) {
+    return a * (kOne - w) + b * w;
+  }
+
+  // Rounds `v`, an entry value with `weight_bits` fraction bits, to the
+  // output code.
+  uint16_t output(uint64_t v, uint32_t weight_bits) const {
+    const uint32_t shift = weight_bits + output_shift_;
+    return uint16_t((v + (uint64_t(1) << (shift - 1))) >> shift);
+  }
+
+  std::vector<AxisStep> axis_[3];  // 2^in_bits entries each
+  size_t step_[3]{0, 0, 0};        // to the upper sample(0 for one sample)
+  uint16_t max_code_{0};
+  uint32_t output_shift_{0};  // 16 - out_bits
+  int in_bits_{0};
+  int out_bits_{0};
+  LUT3DInterpolation interpolation_{LUT3DInterpolation::kTrilinear};
+  // kPaddedRGBA entries, output code << output_shift_. 64 byte aligned.
+  std::vector<uint16_t, LUTAllocator<uint16_t>> data_;
+};
+
+///
+/// Evaluates `count` interleaved integer pixels with
+/// LUT3DIntegerEvaluator::eval(). uint8_t pixels hold 8-bit codes, uint16_t
+/// pixels codes of up to 16 bits(see in_bits() and out_bits()). Strides are
+/// in components(3 for RGB, 4 for RGBA, alpha is left as is). `dst` can be
+/// `src` when both have the same type.
+///
+/// @return false(nothing is written) when `evaluator` is not initialized, or
+/// `src`(`dst`) is uint8_t but in_bits()(out_bits()) is not 8.
+///
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint8_t *src,
+                uint8_t *dst, size_t count, size_t src_stride = 3,
+                size_t dst_stride = 3);
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint8_t *src,
+                uint16_t *dst, size_t count, size_t src_stride = 3,
+                size_t dst_stride = 3);
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint16_t *src,
+                uint8_t *dst, size_t count, size_t src_stride = 3,
+                size_t dst_stride = 3);
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint16_t *src,
+                uint16_t *dst, size_t count, size_t src_stride = 3,
+                size_t dst_stride = 3);
+
+///
+/// Read-only view of a whole file.
+/// Uses mmap() on POSIX systems and falls back to reading the file into a
+/// heap buffer elsewhere(or when `TINY_COLOR_IO_NO_MMAP` is defined).
+///
+class MappedFile {
+ public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() { close(); }
+
+  bool open(const std::string &filename, std::string *err = nullptr);
+
+  void close();
+
+  const char *data() const { return data_; }
+
+  size_t size() const { return size_; }
+
+ private:
+  void *mapped_{nullptr};
+  std::vector<char> buf_;
+  const char *data_{nullptr};
+  size_t size_{0};
+};
+
+///
+/// Options for LUT loaders.
+///
+struct LoadOptions {
+  ///
+  /// Number of threads used to parse the LUT body.
+  /// 0 = std::thread::hardware_concurrency(). Small LUTs are always parsed
+  /// on the calling thread.
+  ///
+  uint32_t num_threads{1};
+
+  ///
+  /// Optional external executor(e.g. an application thread pool).
+  /// When set, the loader calls `executor(num_tasks, task)` instead of
+  /// spawning threads. `task(i)` must have been run for every i in
+  /// [0, num_tasks) when `executor` returns. `num_threads` is ignored.
+  ///
+  std::function<void(size_t num_tasks,
+                     const std::function<void(size_t)> &task)>
+      executor;
+
+  ///
+  /// Maximum size of each LUT dimension(1D length, 3D x/y/z size).
+  /// Larger LUTs are rejected before any allocation. 0 = no limit.
+  ///
+  size_t max_dim{1u << 20};
+
+  ///
+  /// Maximum bytes the loader may allocate for a LUT, including temporary
+  /// parse buffers. 0 = no limit.
+  ///
+  size_t max_memory{size_t(1) << 30};
+
+  ///
+  /// Optional progress callback. Called with a value in [0, 1] after each
+  /// parsed chunk of the LUT body. Calls are serialized but may come from
+  /// worker threads.
+  ///
+  std::function<void(float progress)> progress;
+
+  ///
+  /// Optional cancellation flag. The loader checks it between chunks of the
+  /// body(SPI3D), every few thousand entries(SPI1D) or between checksum, copy
+  /// and layout conversion(binary container), and fails with
+  /// "LUT loading is cancelled." once it becomes true.
+  ///
+  const std::atomic<bool> *cancel{nullptr};
+
+  ///
+  /// Layout of loaded 3D LUTs.
+  ///
+  LUT3DLayout layout{LUT3DLayout::kInterleaved};
+
+  ///
+  /// Value range mapped to [0, 65535] when loading into LUT3Du16. Values
+  /// are quantized while parsing and clamped to this range. Both ends must
+  /// be finite with [0] < [1].
+  ///
+  std::array<float, 2> quantize_range{{0.0f, 1.0f}};
+};
+
+///
+/// Loads SPI1D LUT data(ASCII). `Components` must be 1 or 3.
+///
+/// @param[in] filename spi1d LUT filename.
+/// @param[out] lut 1D LUT table.
+/// @param[out] err Error message(when failed to load a LUT).
+/// @return true upon succes.
+///
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Df *lut,
+                       std::string *err = nullptr);
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Df *lut,
+                       const LoadOptions &options,
+                       std::string *err = nullptr);
+
+///
+/// Loads SPI1D LUT data(ASCII) from memory.
+/// `data` is parsed in place and is not retained after the call returns.
+///
+/// @param[in] data Pointer to spi1d file content(need not be
+/// null-terminated).
+/// @param[in] len Byte length of `data`.
+/// @param[out] lut 1D LUT table.
+/// @param[out] err Error message(when failed to load a LUT).
+/// @return true upon succes.
+///
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Df *lut,
+                         std::string *err = nullptr);
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Df *lut,
+                         const LoadOptions &options,
+                         std::string *err = nullptr);
+
+///
+/// Loads SPI3D LUT data(ASCII)
+///
+/// @param[in] filename spi3d LUT filename.
+/// @param[out] lut 3D LUT table.
+/// @param[out] err Error message(when failed to load a LUT).
+/// @return true upon succes.
+///
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
+                       std::string *err = nullptr);
+
+///
+/// Loads SPI3D LUT data(ASCII) with options.
+/// Every body line carries its own indices, so the body is split into
+/// newline aligned chunks which are parsed concurrently when
+/// `options.num_threads` != 1 or `options.executor` is set.
+///
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
+                       const LoadOptions &options,
+                       std::string *err = nullptr);
+
+///
+/// Loads SPI3D LUT data(ASCII) from memory.
+/// `data` is parsed in place and is not retained after the call returns.
+///
+/// @param[in] data Pointer to spi3d file content(need not be
+/// null-terminated).
+/// @param[in] len Byte length of `data`.
+/// @param[out] lut 3D LUT table.
+/// @param[out] err Error message(when failed to load a LUT).
+/// @return true upon succes.
+///
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Df *lut,
+                         std::string *err = nullptr);
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Df *lut,
+                         const LoadOptions &options,
+                         std::string *err = nullptr);
+
+///
+/// Loads SPI LUT into half float storage. Values are converted while
+/// parsing, except for blue-fastest SPI3D files, which are staged as float
+/// and converted while transposing(see `LoadOptions::max_memory`).
+///
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Dh *lut,
+                       const LoadOptions &options = LoadOptions(),
+                       std::string *err = nullptr);
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Dh *lut,
+                       const LoadOptions &options = LoadOptions(),
+                       std::string *err = nullptr);
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Dh *lut,
+                         const LoadOptions &options = LoadOptions(),
+                         std::string *err = nullptr);
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Dh *lut,
+                         const LoadOptions &options = LoadOptions(),
+                         std::string *err = nullptr);
+
+///
+/// Loads SPI3D LUT quantized to 16 bits with `options.quantize_range`.
+///
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Du16 *lut,
+                       const LoadOptions &options = LoadOptions(),
+                       std::string *err = nullptr);
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Du16 *lut,
+                         const LoadOptions &options = LoadOptions(),
+                         std::string *err = nullptr);
+
+//
+// Binary LUT container
+//
+// Little endian layout:
+//
+//   [0, 128)          LUTBinaryHeader
+//   [payload_offset)  LUT values(64 byte aligned, `payload_size` bytes)
+//
+// 3D payload is `LUT3D::data_` in the layout given by `layout_flags`.
+// 1D payload is `length * components` values.
+//
+
+constexpr uint32_t kLUTBinaryVersion = 1;
+constexpr size_t kLUTBinaryAlignment = 64;
+
+enum class LUTElementType : uint32_t {
+  kFloat32 = 0,
+};
+
+///
+/// Values of `LUTBinaryHeader::layout_flags`(same as LUT3DLayout).
+///
+enum LUTLayoutFlags : uint32_t {
+  kLUTLayoutInterleaved = 0,  // RGBRGB..., x fastest
+  kLUTLayoutPlanar = 1,       // RRR...GGG...BBB...
+  kLUTLayoutPaddedRGBA = 2,   // RGB_RGB_...
+  kLUTLayoutBrickedRGBA = 3,  // RGB_ in 4x4x4 bricks, dims padded to 4
+};
+
+struct LUTBinaryHeader {
+  char magic[8];              // "TCIOLUT\0"
+  uint32_t version;           // kLUTBinaryVersion
+  uint32_t header_size;       // sizeof(LUTBinaryHeader)
+  uint32_t num_dims;          // 1 or 3
+  uint32_t element_type;      // LUTElementType
+  uint32_t components;        // 3 for 3D LUT
+  uint32_t layout_flags;      // LUTLayoutFlags
+  uint64_t dims[3];           // 1D: {length, 1, 1}
+  float x_range[2];           // 1D input range
+  uint64_t payload_offset;    // multiple of kLUTBinaryAlignment
+  uint64_t payload_size;      // in bytes
+  uint64_t payload_checksum;  // LUTBinaryChecksum() of the payload
+  uint8_t reserved[40];
+};
+
+static_assert(sizeof(LUTBinaryHeader) == 128,
+              "LUTBinaryHeader must be 128 bytes");
+
+///
+/// 64-bit Fletcher style checksum used by the binary container.
+///
+uint64_t LUTBinaryChecksum(const void *data, size_t len);
+
+///
+/// Saves 3D LUT as binary container.
+///
+/// @param[in] filename Output filename.
+/// @param[in] lut 3D LUT table.
+/// @param[out] err Error message(when failed to save a LUT).
+/// @return true upon succes.
+///
+bool SaveLUTBinaryToFile(const std::string &filename, const LUT3Df &lut,
+                         std::string *err = nullptr);
+
+///
+/// Saves 1D LUT as binary container.
+///
+bool SaveLUTBinaryToFile(const std::string &filename, const LUT1Df &lut,
+                         std::string *err = nullptr);
+
+///
+/// mmap-backed reader for the binary container.
+/// The payload is handed out in place; pointers stay valid until the file
+/// is closed or destroyed.
+///
+class LUTBinaryFile {
+ public:
+  ///
+  /// Maps `filename` and validates the header.
+  ///
+  /// @param[in] filename Binary LUT filename.
+  /// @param[out] err Error message(when failed to open).
+  /// @param[in] verify_checksum Verify payload checksum. This touches every
+  /// page of the payload.
+  /// @return true upon succes.
+  ///
+  bool open(const std::string &filename, std::string *err = nullptr,
+            bool verify_checksum = false);
+
+  void close() { file_.close(); }
+
+  const LUTBinaryHeader &header() const { return header_; }
+
+  ///
+  /// Returns payload pointer(64 byte aligned when mmap is used).
+  ///
+  const void *payload() const {
+    return file_.data() + header_.payload_offset;
+  }
+
+  size_t payload_size() const { return size_t(header_.payload_size); }
+
+  ///
+  /// Returns payload as float array, or nullptr when the element type is
+  /// not float.
+  ///
+  const float *data_f32() const {
+    return (header_.element_type == uint32_t(LUTElementType::kFloat32))
+               ? static_cast<const float *>(payload())
+               : nullptr;
+  }
+
+  ///
+  /// Returns the payload as a LUT without copying. Valid until the file is
+  /// closed or destroyed.
+  ///
+  /// @return false when the file is not a float 3D(or 1D) LUT.
+  ///
+  bool view(LUT3DViewf *lut, std::string *err = nullptr) const;
+
+  bool view(LUT1DViewf *lut, std::string *err = nullptr) const;
+
+ private:
+  MappedFile file_;
+  LUTBinaryHeader header_;
+};
+
+///
+/// Validates binary LUT container in memory and returns its header.
+///
+bool ParseLUTBinaryHeader(const char *data, size_t len,
+                          LUTBinaryHeader *header,
+                          std::string *err = nullptr);
+
+///
+/// Validates binary LUT container in memory(e.g. a caller managed mapping)
+/// and returns its payload as a LUT without copying. The payload checksum
+/// is not verified, as that would touch every page. `data` must be 4 byte
+/// aligned and outlive `lut`.
+///
+bool ViewLUTBinaryFromMemory(const char *data, size_t len, LUT3DViewf *lut,
+                             std::string *err = nullptr);
+
+bool ViewLUTBinaryFromMemory(const char *data, size_t len, LUT1DViewf *lut,
+                             std::string *err = nullptr);
+
+///
+/// Loads binary 3D LUT from file(payload is copied into `lut`).
+///
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT3Df *lut,
+                           std::string *err = nullptr);
+
+///
+/// Loads binary 1D LUT from file(payload is copied into `lut`).
+///
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT1Df *lut,
+                           std::string *err = nullptr);
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT3Df *lut,
+                             std::string *err = nullptr);
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT1Df *lut,
+                             std::string *err = nullptr);
+
+///
+/// Loads binary LUT with `options.max_dim` and `options.max_memory` limits.
+///
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT3Df *lut,
+                           const LoadOptions &options,
+                           std::string *err = nullptr);
+
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT1Df *lut,
+                           const LoadOptions &options,
+                           std::string *err = nullptr);
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT3Df *lut,
+                             const LoadOptions &options,
+                             std::string *err = nullptr);
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT1Df *lut,
+                             const LoadOptions &options,
+                             std::string *err = nullptr);
+
+///
+/// Format of a LUT file.
+///
+enum class LUTFormat : uint32_t {
+  kUnknown = 0,
+  kSPI1D,
+  kSPI3D,
+  kBinary,  // Binary LUT container
+};
+
+///
+/// LUT description obtained from header lines only.
+///
+struct LUTInfo {
+  LUTFormat format{LUTFormat::kUnknown};
+  uint32_t num_dims{0};        // 1 or 3
+  size_t dims[3] = {0, 0, 0};  // 1D: {length, 1, 1}
+  size_t components{0};
+  LUTElementType element_type{LUTElementType::kFloat32};
+  size_t data_size{0};  // Byte size of LUT values once loaded
+};
+
+///
+/// Reads LUT format, dimensions and size without parsing the body.
+/// Only the first 4 KB of the file are read.
+///
+/// @param[in] filename LUT filename(spi1d, spi3d or binary container).
+/// @param[out] info LUT description.
+/// @param[out] err Error message(when failed to probe).
+/// @return true upon succes.
+///
+bool ProbeLUTFile(const std::string &filename, LUTInfo *info,
+                  std::string *err = nullptr);
+
+///
+/// Same as ProbeLUTFile() for a LUT already in memory.
+/// Only header lines of `data` are touched.
+///
+bool ProbeLUTMemory(const char *data, size_t len, LUTInfo *info,
+                    std::string *err = nullptr);
+
+///
+/// Fixed size thread pool used by asynchronous loaders.
+///
+class ThreadPool {
+ public:
+  ///
+  /// @param[in] num_threads Number of worker threads.
+  /// 0 = std::thread::hardware_concurrency().
+  ///
+  explicit ThreadPool(size_t num_threads = 0);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  ///
+  /// Runs all queued tasks and joins worker threads.
+  ///
+  ~ThreadPool();
+
+  void submit(std::function<void()> task);
+
+  size_t num_threads() const { return threads_.size(); }
+
+  ///
+  /// Returns process wide pool(hardware_concurrency threads) used when no
+  /// pool is given to asynchronous loaders.
+  ///
+  static ThreadPool &default_pool();
+
+ private:
+  void run();
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_{false};
+};
+
+template <typename LUT>
+struct LUTLoadState {
+  std::atomic<bool> cancel{false};
+  std::atomic<float> progress{0.0f};
+  bool ok{false};
+  LUT lut;
+  std::string err;
+};
+
+///
+/// Handle of an asynchronous LUT load.
+///
+template <typename LUT>
+class LUTLoadTask {
+ public:
+  LUTLoadTask() = default;
+
+  LUTLoadTask(std::shared_ptr<LUTLoadState<LUT>> state,
+              std::shared_future<void> done)
+      : state_(std::move(state)), done_(std::move(done)) {}
+
+  bool valid() const { return state_ != nullptr; }
+
+  ///
+  /// Requests cooperative cancellation. The load stops at the next chunk
+  /// boundary and `get()` returns false.
+  ///
+  void cancel() {
+    if (state_) {
+      state_->cancel = true;
+    }
+  }
+
+  ///
+  /// Returns progress in [0, 1].
+  ///
+  float progress() const { return state_ ? state_->progress.load() : 0.0f; }
+
+  bool is_ready() const {
+    return done_.valid() && (done_.wait_for(std::chrono::seconds(0)) ==
+                             std::future_status::ready);
+  }
+
+  void wait() const {
+    if (done_.valid()) {
+      done_.wait();
+    }
+  }
+
+  ///
+  /// Waits for the load and moves the LUT to `lut`. Call only once.
+  ///
+  /// @param[out] lut Loaded LUT.
+  /// @param[out] err Error message(when failed or cancelled).
+  /// @return true upon succes.
+  ///
+  bool get(LUT *lut, std::string *err = nullptr) {
+    if (!state_) {
+      if (err) {
+        (*err) = "Invalid LUT load task.";
+      }
+      return false;
+    }
+
+    wait();
+    if (!state_->ok) {
+      if (err) {
+        (*err) = state_->err;
+      }
+      return false;
+    }
+
+    if (lut) {
+      (*lut) = std::move(state_->lut);
+    }
+    return true;
+  }
+
+ private:
+  std::shared_ptr<LUTLoadState<LUT>> state_;
+  std::shared_future<void> done_;
+};
+
+///
+/// Loads 3D LUT(spi3d or binary container) on a thread pool.
+///
+/// @param[in] filename LUT filename.
+/// @param[in] options Load options. `progress` is also reported to the
+/// returned task and `cancel` is replaced by the task's own flag.
+/// @param[in] pool Thread pool. nullptr = ThreadPool::default_pool().
+/// @return Task handle.
+///
+LUTLoadTask<LUT3Df> LoadLUT3DFromFileAsync(
+    const std::string &filename, const LoadOptions &options = LoadOptions(),
+    ThreadPool *pool = nullptr);
+
+///
+/// Loads 1D LUT(spi1d or binary container) on a thread pool.
+///
+LUTLoadTask<LUT1Df> LoadLUT1DFromFileAsync(
+    const std::string &filename, const LoadOptions &options = LoadOptions(),
+    ThreadPool *pool = nullptr);
+
+///
+/// Result of a batch load. Either `lut1d` or `lut3d` is filled depending
+/// on `format` and the LUT dimension.
+///
+struct LUTBatchResult {
+  bool ok{false};
+  LUTFormat format{LUTFormat::kUnknown};
+  uint32_t num_dims{0};  // 1 or 3
+  LUT1Df lut1d;
+  LUT3Df lut3d;
+  std::string err;
+};
+
+///
+/// Loads many LUT files(e.g. every LUT of an OCIO config) at once.
+/// Reads are issued through io_uring on Linux(falls back to pread() on the
+/// thread pool when unavailable) and each file is parsed on `pool` as soon
+/// as its read completes. At most 64 files are open(read buffer allocated)
+/// at a time, and files larger than `options.max_memory` are rejected before
+/// their buffer is allocated.
+/// Must not be called from a task running on `pool`.
+///
+/// @param[in] filenames LUT filenames(spi1d, spi3d or binary container).
+/// @param[out] results Per file results(same order as `filenames`).
+/// @param[in] options Load options used for each file.
+/// @param[in] pool Thread pool. nullptr = ThreadPool::default_pool().
+/// @return true when all files are loaded.
+///
+bool LoadLUTFiles(const std::vector<std::string> &filenames,
+                  std::vector<LUTBatchResult> *results,
+                  const LoadOptions &options = LoadOptions(),
+                  ThreadPool *pool = nullptr);
+
+}  // namespace tinycolorio
+
+#endif  // TINY_COLOR_IO_H_
+
+#ifdef TINY_COLOR_IO_IMPLEMENTATION
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+#if !defined(TINY_COLOR_IO_NO_SIMD) &&                              \
+    (defined(__SSE2__) || defined(_M_X64) ||                         \
+     (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define TINYCOLORIO_USE_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#define TINYCOLORIO_TARGET_AVX2
+#define TINYCOLORIO_TARGET_AVX2_FMA
+#define TINYCOLORIO_TARGET_AVX512F
+#define TINYCOLORIO_TARGET_F16C
+#define TINYCOLORIO_TARGET_SSE41
+#else
+#define TINYCOLORIO_TARGET_AVX2 __attribute__((target("avx2")))
+#define TINYCOLORIO_TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#define TINYCOLORIO_TARGET_AVX512F __attribute__((target("avx512f")))
+#define TINYCOLORIO_TARGET_F16C __attribute__((target("f16c")))
+#define TINYCOLORIO_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && !defined(TINY_COLOR_IO_NO_IO_URING) && \
+    defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define TINYCOLORIO_USE_IO_URING
+#endif
+#endif
+#endif
+
+namespace tinycolorio {
+
+namespace {
+
+inline int CountTrailingZeros32(uint32_t v) {
+#if defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanForward(&idx, v);
+  return int(idx);
+#else
+  return __builtin_ctz(v);
+#endif
+}
+
+struct CPUFeatures {
+  bool avx2{false};
+  bool avx512f{false};
+  bool f16c{false};
+  bool fma{false};
+  bool sse41{false};
+};
+
+inline const CPUFeatures &GetCPUFeatures() {
+  static const CPUFeatures features = []() {
+    CPUFeatures f;
+#if defined(TINYCOLORIO_USE_SSE2)
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 0);
+    int max_leaf = regs[0];
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool ymm_enabled = osxsave && ((_xgetbv(0) & 0x6) == 0x6);
+    f.f16c = ymm_enabled && ((regs[2] & (1 << 29)) != 0);
+    f.fma = ymm_enabled && ((regs[2] & (1 << 12)) != 0);
+    f.sse41 = (regs[2] & (1 << 19)) != 0;
+    if (max_leaf >= 7) {
+      __cpuidex(regs, 7, 0);
+      f.avx2 = ymm_enabled && ((regs[1] & (1 << 5)) != 0);
+      // ZMM and opmask state enabled by the OS as well.
+      bool zmm_enabled = osxsave && ((_xgetbv(0) & 0xe6) == 0xe6);
+      f.avx512f = zmm_enabled && ((regs[1] & (1 << 16)) != 0);
+    }
+#else
+    __builtin_cpu_init();
+    f.avx2 = __builtin_cpu_supports("avx2");
+    f.avx512f = __builtin_cpu_supports("avx512f");
+    f.f16c = __builtin_cpu_supports("f16c");
+    f.fma = __builtin_cpu_supports("fma");
+    f.sse41 = __builtin_cpu_supports("sse4.1");
+#endif
+#endif
+    return f;
+  }();
+  return features;
+}
+
+// Multiplies sizes. Returns false on overflow.
+inline bool MulSize(size_t a, size_t b, size_t *out) {
+  if ((a != 0) && (b > (std::numeric_limits<size_t>::max() / a))) {
+    return false;
+  }
+  (*out) = a * b;
+  return true;
+}
+
+//
+// Locale independent scanner.
+// All functions take [p, end) and never read past `end`.
+//
+
+inline bool IsDigit(char c) { return (c >= '0') && (c <= '9'); }
+
+// Whitespace excluding newline.
+inline bool IsSpace(char c) {
+  return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') ||
+         (c == '\f');
+}
+
+inline const char *SkipSpaces(const char *p, const char *end) {
+  while ((p < end) && IsSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+inline bool IsWhitespace(char c) { return IsSpace(c) || (c == '\n'); }
+
+inline const char *SkipWhitespacesScalar(const char *p, const char *end) {
+  while ((p < end) && IsWhitespace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+#if defined(TINYCOLORIO_USE_SSE2)
+
+// ' ' or '\t'..'\r'(the contiguous range [9, 13]).
+inline __m128i WhitespaceMaskSSE2(__m128i v) {
+  __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+  __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+  return _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+inline const char *SkipWhitespacesSSE2(const char *p, const char *end) {
+  while ((end - p) >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    uint32_t mask = ~uint32_t(_mm_movemask_epi8(WhitespaceMaskSSE2(v)));
+    if (mask & 0xffff) {
+      return p + CountTrailingZeros32(mask);
+    }
+    p += 16;
+  }
+  return SkipWhitespacesScalar(p, end);
+}
+
+TINYCOLORIO_TARGET_AVX2
+inline const char *SkipWhitespacesAVX2(const char *p, const char *end) {
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i four = _mm256_set1_epi8(4);
+  const __m256i space = _mm256_set1_epi8(' ');
+  while ((end - p) >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    __m256i t = _mm256_sub_epi8(v, tab);
+    __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(t, four), t);
+    __m256i ws = _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(v, space));
+    uint32_t mask = ~uint32_t(_mm256_movemask_epi8(ws));
+    if (mask) {
+      return p + CountTrailingZeros32(mask);
+    }
+    p += 32;
+  }
+  return SkipWhitespacesScalar(p, end);
+}
+
+#endif  // TINYCOLORIO_USE_SSE2
+
+using SkipWhitespacesFn = const char *(*)(const char *, const char *);
+
+SkipWhitespacesFn SelectSkipWhitespaces() {
+#if defined(TINYCOLORIO_USE_SSE2)
+  if (GetCPUFeatures().avx2) {
+    return SkipWhitespacesAVX2;
+  }
+  return SkipWhitespacesSSE2;
+#else
+  return SkipWhitespacesScalar;
+#endif
+}
+
+// Skips whitespace including newlines.
+inline const char *SkipWhitespaces(const char *p, const char *end) {
+  // Separators are usually one or two bytes. Longer runs(indentation,
+  // blank lines, padded columns) go to the vectorized scanner.
+  if ((p < end) && !IsWhitespace(*p)) {
+    return p;
+  }
+  if (((p + 1) < end) && !IsWhitespace(p[1])) {
+    return p + 1;
+  }
+  static const SkipWhitespacesFn skip = SelectSkipWhitespaces();
+  return skip(p, end);
+}
+
+// Returns the position just after the next '\n'(or `end`).
+inline const char *SkipLine(const char *p, const char *end) {
+  if (p >= end) {
+    return end;
+  }
+  const void *nl = memchr(p, '\n', size_t(end - p));
+  return nl ? static_cast<const char *>(nl) + 1 : end;
+}
+
+// Returns the end of the current line('\n' or `end`).
+inline const char *FindLineEnd(const char *p, const char *end) {
+  if (p >= end) {
+    return end;
+  }
+  const void *nl = memchr(p, '\n', size_t(end - p));
+  return nl ? static_cast<const char *>(nl) : end;
+}
+
+// Skips leading spaces(not newlines) and parses a decimal integer.
+inline bool ParseInt(const char **pp, const char *end, int *out) {
+  const char *p = SkipSpaces(*pp, end);
+
+  bool neg = false;
+  if ((p < end) && ((*p == '-') || (*p == '+'))) {
+    neg = (*p == '-');
+    p++;
+  }
+
+  if ((p >= end) || !IsDigit(*p)) {
+    return false;
+  }
+
+  int64_t v = 0;
+  while ((p < end) && IsDigit(*p)) {
+    v = v * 10 + (*p - '0');
+    if (v > 0x7fffffff) {
+      return false;
+    }
+    p++;
+  }
+
+  (*out) = int(neg ? -v : v);
+  (*pp) = p;
+  return true;
+}
+
+// Exactly representable powers of ten in double.
+static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Exactly representable powers of ten in float.
+static const float kPow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+// Skips leading spaces(not newlines) and parses a decimal floating point
+// number([+-]digits[.digits][(e|E)[+-]digits]).
+// Up to 19 significant digits are accumulated into an integer and scaled
+// by an exact power of ten. Values with a mantissa below 2^24 and at most
+// 10 fraction digits(typical "%f" LUT values) take a float path with a
+// single, correct rounding. Others are scaled in double and then rounded to
+// float, i.e. rounded twice, which can be one ulp off the correctly rounded
+// float for values near a halfway point.
+inline bool ParseFloat(const char **pp, const char *end, float *out) {
+  const char *p = SkipSpaces(*pp, end);
+
+  bool neg = false;
+  if ((p < end) && ((*p == '-') || (*p == '+'))) {
+    neg = (*p == '-');
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int num_digits = 0;  // significant digits stored in `mantissa`
+  int exp10 = 0;
+  bool has_digits = false;
+
+  while ((p < end) && IsDigit(*p)) {
+    has_digits = true;
+    if (num_digits < 19) {
+      mantissa = mantissa * 10 + uint64_t(*p - '0');
+      if (mantissa) {
+        num_digits++;
+      }
+    } else {
+      exp10++;
+    }
+    p++;
+  }
+
+  if ((p < end) && (*p == '.')) {
+    p++;
+    while ((p < end) && IsDigit(*p)) {
+      has_digits = true;
+      if (num_digits < 19) {
+        mantissa = mantissa * 10 + uint64_t(*p - '0');
+        if (mantissa) {
+          num_digits++;
+        }
+        exp10--;
+      }
+      p++;
+    }
+  }
+
+  if (!has_digits) {
+    return false;
+  }
+
+  if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+    const char *q = p + 1;
+    bool exp_neg = false;
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+      exp_neg = (*q == '-');
+      q++;
+    }
+    if ((q < end) && IsDigit(*q)) {
+      int e = 0;
+      while ((q < end) && IsDigit(*q)) {
+        if (e < 10000) {
+          e = e * 10 + (*q - '0');
+        }
+        q++;
+      }
+      exp10 += exp_neg ? -e : e;
+      p = q;
+    }
+  }
+
+  // Both operands are exact in float, so a single float division gives
+  // the correctly rounded result. This covers the usual "%f" style values.
+  if ((mantissa < (uint64_t(1) << 24)) && (exp10 <= 0) && (exp10 >= -10)) {
+    float f = float(int32_t(mantissa)) / kPow10f[-exp10];
+    (*out) = neg ? -f : f;
+    (*pp) = p;
+    return true;
+  }
+
+  // Rounded to double here and to float at the end(see above).
+  double v = double(mantissa);
+  if (mantissa == 0) {
+    v = 0.0;
+  } else if ((exp10 >= 0) && (exp10 <= 22)) {
+    v *= kPow10[exp10];
+  } else if ((exp10 < 0) && (exp10 >= -22)) {
+    v /= kPow10[-exp10];
+  } else {
+    v *= std::pow(10.0, double(exp10));
+  }
+
+  (*out) = static_cast<float>(neg ? -v : v);
+  (*pp) = p;
+  return true;
+}
+
+// Case insensitive substring search in [p, end).
+inline bool ContainsNoCase(const char *p, const char *end, const char *word) {
+  size_t n = strlen(word);
+  for (; size_t(end - p) >= n; p++) {
+    size_t i = 0;
+    while ((i < n) && (std::tolower(static_cast<unsigned char>(p[i])) ==
+                       static_cast<unsigned char>(word[i]))) {
+      i++;
+    }
+    if (i == n) {
+      return true;
+    }
+  }
+  return false;
+}
+
+///
+/// Runs `task(i)` for i in [0, num_tasks) using `options.executor` or
+/// `options.num_threads` worker threads.
+///
+void ParallelFor(size_t num_tasks, const LoadOptions &options,
+                 const std::function<void(size_t)> &task) {
+  if (num_tasks == 0) {
+    return;
+  }
+
+  if (options.executor) {
+    options.executor(num_tasks, task);
+    return;
+  }
+
+  size_t num_threads = options.num_threads;
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, num_tasks);
+
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < num_tasks; i++) {
+      task(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  // The first exception of any task is rethrown after the join.
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+  auto worker = [&]() {
+    try {
+      size_t i;
+      while ((i = next.fetch_add(1)) < num_tasks) {
+        task(i);
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(exception_mutex);
+      if (!exception) {
+        exception = std::current_exception();
+      }
+      next = num_tasks;  // stop handing out tasks
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto &th : threads) {
+    th.join();
+  }
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+///
+/// Splits [begin, end) into at most `max_chunks` newline aligned ranges of
+/// at least `min_chunk_size` bytes. Returns chunk boundaries(size = n + 1).
+///
+std::vector<const char *> SplitLines(const char *begin, const char *end,
+                                     size_t max_chunks,
+                                     size_t min_chunk_size) {
+  size_t len = size_t(end - begin);
+  size_t n = std::max(size_t(1), std::min(max_chunks, len / min_chunk_size));
+
+  std::vector<const char *> bounds;
+  bounds.push_back(begin);
+  for (size_t i = 1; i < n; i++) {
+    const char *p = begin + (len * i) / n;
+    if (p <= bounds.back()) {
+      continue;
+    }
+    p = SkipLine(p, end);
+    if (p >= end) {
+      break;
+    }
+    bounds.push_back(p);
+  }
+  bounds.push_back(end);
+  return bounds;
+}
+
+// Number of values stored per 3D LUT entry.
+inline bool IsRGBALayout(LUT3DLayout layout) {
+  return (layout == LUT3DLayout::kPaddedRGBA) ||
+         (layout == LUT3DLayout::kBrickedRGBA);
+}
+
+inline size_t LayoutComponents(LUT3DLayout layout) {
+  return IsRGBALayout(layout) ? 4 : 3;
+}
+
+///
+/// Checks LUT dimensions against `options` limits before allocation.
+///
+bool CheckLUTSize(const size_t dims[3], size_t components, size_t elem_size,
+                  const LoadOptions &options, std::string *err) {
+  for (int i = 0; i < 3; i++) {
+    if ((options.max_dim > 0) && (dims[i] > options.max_dim)) {
+      if (err) {
+        (*err) = "LUT dimension " + std::to_string(dims[i]) +
+                 " exceeds max_dim " + std::to_string(options.max_dim);
+      }
+      return false;
+    }
+  }
+
+  size_t bytes = components;
+  if (!MulSize(bytes, dims[0], &bytes) || !MulSize(bytes, dims[1], &bytes) ||
+      !MulSize(bytes, dims[2], &bytes) ||
+      !MulSize(bytes, elem_size, &bytes) ||
+      ((options.max_memory > 0) && (bytes > options.max_memory))) {
+    if (err) {
+      (*err) = "LUT size exceeds max_memory " +
+               std::to_string(options.max_memory) + " bytes";
+    }
+    return false;
+  }
+
+  return true;
+}
+
+// Shortest possible SPI3D entry line: "0 0 0 0 0 0\n".
+constexpr size_t kMinSPI3DEntrySize = 12;
+
+struct SPI3DHeader {
+  int x_size{0};
+  int y_size{0};
+  int z_size{0};
+  const char *body{nullptr};  // points to the first entry line
+};
+
+bool ParseSPI3DHeader(const char *p, const char *end, SPI3DHeader *header,
+                      std::string *err) {
+  const char *line_end = FindLineEnd(p, end);
+  if (!ContainsNoCase(p, line_end, "spilut")) {
+    if (err) {
+      (*err) = "Not a SPILUT format. header = " + std::string(p, line_end);
+    }
+    return false;
+  }
+  p = SkipLine(p, end);
+
+  // ignore 2nd line(assuming 3 3)
+  p = SkipLine(p, end);
+
+  // lut size
+  if (!ParseInt(&p, end, &header->x_size) ||
+      !ParseInt(&p, end, &header->y_size) ||
+      !ParseInt(&p, end, &header->z_size) || (header->x_size <= 0) ||
+      (header->y_size <= 0) || (header->z_size <= 0)) {
+    if (err) {
+      (*err) = "Error while reading lut size";
+    }
+    return false;
+  }
+
+  header->body = SkipLine(p, end);
+  return true;
+}
+
+///
+/// Converts parsed values to LUT storage type `T`.
+///
+template <typename T>
+struct ValueEncoder {
+  void init(float, float) {}
+  T operator()(float v) const { return T(v); }
+};
+
+template <>
+struct ValueEncoder<uint16_t> {
+  float offset{0.0f};
+  float inv_scale{65535.0f};
+
+  void init(float lut_offset, float lut_scale) {
+    offset = lut_offset;
+    inv_scale = (lut_scale > 0.0f) ? (1.0f / lut_scale) : 0.0f;
+  }
+
+  uint16_t operator()(float v) const {
+    v = (v - offset) * inv_scale;
+    v = (v > 0.0f) ? ((v < 65535.0f) ? v : 65535.0f) : 0.0f;  // NaN -> 0
+    return uint16_t(v + 0.5f);
+  }
+};
+
+bool CheckQuantizeRange(float lo, float hi, std::string *err) {
+  if (!std::isfinite(lo) || !std::isfinite(hi) || !(lo < hi) ||
+      !std::isfinite(hi - lo)) {
+    if (err) {
+      (*err) = "Invalid quantize range : [" + std::to_string(lo) + ", " +
+               std::to_string(hi) + "]";
+    }
+    return false;
+  }
+  return true;
+}
+
+// Sets quantization of integer LUTs from `options.quantize_range`.
+template <typename T>
+void SetQuantization(const LoadOptions &options, LUT3D<T> *lut) {
+  if (std::is_integral<T>::value) {
+    lut->offset_ = options.quantize_range[0];
+    lut->scale_ = (options.quantize_range[1] - options.quantize_range[0]) /
+                  float(std::numeric_limits<T>::max());
+  }
+}
+
+///
+/// Destination of parsed SPI3D entries. Component c of (x, y, z) is stored
+/// at `data[x * stride[0] + y * stride[1] + z * stride[2] + c *
+/// component_stride]`.
+///
+template <typename T>
+struct SPI3DTarget {
+  T *data{nullptr};
+  int size[3] = {0, 0, 0};
+  size_t stride[3] = {0, 0, 0};
+  size_t component_stride{1};
+  bool padded{false};  // Zero the 4th value of each entry.
+  ValueEncoder<T> encode;
+
+  // Flags of parsed entries(x fastest). Chunks are parsed concurrently, so
+  // an entry is stored only by the chunk that sets its flag first and a
+  // duplicate entry fails the load.
+  std::atomic<uint8_t> *written{nullptr};
+};
+
+///
+/// Parses `x y z r g b` lines in [p, end) and stores them to `dst`.
+/// Fails when more than `max_entries` entries are found.
+///
+template <typename T>
+bool ParseSPI3DEntries(const char *p, const char *end, size_t max_entries,
+                       const SPI3DTarget<T> &dst, size_t *num_entries,
+                       std::string *err) {
+  const int x_size = dst.size[0];
+  const int y_size = dst.size[1];
+  const int z_size = dst.size[2];
+
+  size_t n = 0;
+
+  while (true) {
+    p = SkipWhitespaces(p, end);
+    if (p == end) {
+      break;
+    }
+
+    if (n == max_entries) {
+      if (err) {
+        (*err) = "Too many LUT entries. expected " +
+                 std::to_string(max_entries);
+      }
+      return false;
+    }
+
+    const char *line = p;
+    int x_idx = 0, y_idx = 0, z_idx = 0;
+    float rgb[3];
+
+    if (!ParseInt(&p, end, &x_idx) || !ParseInt(&p, end, &y_idx) ||
+        !ParseInt(&p, end, &z_idx) || !ParseFloat(&p, end, &rgb[0]) ||
+        !ParseFloat(&p, end, &rgb[1]) || !ParseFloat(&p, end, &rgb[2])) {
+      if (err) {
+        (*err) = "Failed to parse LUT entry : " +
+                 std::string(line, FindLineEnd(line, end));
+      }
+      return false;
+    }
+
+    p = SkipSpaces(p, end);
+    if ((p < end) && (*p != '\n')) {
+      if (err) {
+        (*err) = "Unexpected character in LUT entry : " +
+                 std::string(line, FindLineEnd(line, end));
+      }
+      return false;
+    }
+
+    if ((x_idx < 0) || (x_idx >= x_size) || (y_idx < 0) ||
+        (y_idx >= y_size) || (z_idx < 0) || (z_idx >= z_size)) {
+      if (err) {
+        (*err) = "LUT index out of range : " + std::to_string(x_idx) + " " +
+                 std::to_string(y_idx) + " " + std::to_string(z_idx);
+      }
+      return false;
+    }
+
+    if (dst.written[(size_t(z_idx) * size_t(y_size) + size_t(y_idx)) *
+                        size_t(x_size) +
+                    size_t(x_idx)]
+            .exchange(1, std::memory_order_relaxed)) {
+      if (err) {
+        (*err) = "Duplicate LUT entry : " + std::to_string(x_idx) + " " +
+                 std::to_string(y_idx) + " " + std::to_string(z_idx);
+      }
+      return false;
+    }
+
+    T *d = dst.data + (size_t(x_idx) * dst.stride[0] +
+                       size_t(y_idx) * dst.stride[1] +
+                       size_t(z_idx) * dst.stride[2]);
+    d[0] = dst.encode(rgb[0]);
+    d[dst.component_stride] = dst.encode(rgb[1]);
+    d[2 * dst.component_stride] = dst.encode(rgb[2]);
+    if (dst.padded) {
+      d[3] = T(0);
+    }
+    n++;
+  }
+
+  (*num_entries) = n;
+  return true;
+}
+
+///
+/// Returns true when the first two entries of `body` differ only in the
+/// blue(z) index, i.e. the file lists entries with blue varying fastest.
+///
+bool IsBlueFastest(const char *p, const char *end) {
+  int idx[2][3];
+  for (int i = 0; i < 2; i++) {
+    p = SkipWhitespaces(p, end);
+    if (!ParseInt(&p, end, &idx[i][0]) || !ParseInt(&p, end, &idx[i][1]) ||
+        !ParseInt(&p, end, &idx[i][2])) {
+      return false;
+    }
+    p = SkipLine(p, end);
+  }
+  return (idx[0][0] == idx[1][0]) && (idx[0][1] == idx[1][1]) &&
+         (idx[0][2] != idx[1][2]);
+}
+
+// Tile size of TransposeSPI3D().
+constexpr size_t kTransposeBlock = 16;
+
+///
+/// Copies z-fastest RGB values(`src[3 * ((x * Y + y) * Z + z)]`) into the
+/// x-fastest layout of `lut`, one cache friendly tile at a time.
+///
+template <typename T>
+void TransposeSPI3D(const float *src, const LoadOptions &options,
+                    LUT3D<T> *lut) {
+  const size_t X = lut->x_dim_;
+  const size_t Y = lut->y_dim_;
+  const size_t Z = lut->z_dim_;
+  const size_t es = lut->entry_stride();
+  const size_t cs = lut->component_stride();
+  T *dst = lut->data_.data();
+  ValueEncoder<T> encode;
+  encode.init(lut->offset_, lut->scale_);
+
+  ParallelFor(Y, options, [&](size_t y) {
+    for (size_t z0 = 0; z0 < Z; z0 += kTransposeBlock) {
+      const size_t z1 = std::min(z0 + kTransposeBlock, Z);
+      for (size_t x0 = 0; x0 < X; x0 += kTransposeBlock) {
+        const size_t x1 = std::min(x0 + kTransposeBlock, X);
+        for (size_t z = z0; z < z1; z++) {
+          T *d = dst + es * ((z * Y + y) * X);
+          for (size_t x = x0; x < x1; x++) {
+            const float *s = src + 3 * ((x * Y + y) * Z + z);
+            d[es * x] = encode(s[0]);
+            d[es * x + cs] = encode(s[1]);
+            d[es * x + 2 * cs] = encode(s[2]);
+            if (es == 4) {
+              d[es * x + 3] = T(0);  // kPaddedRGBA
+            }
+          }
+        }
+      }
+    }
+  });
+}
+
+// Bodies smaller than this are not worth splitting across threads.
+constexpr size_t kMinParseChunkSize = 256 * 1024;
+
+// Chunks used when progress is reported or loading can be cancelled.
+// Bodies smaller than kMinProgressChunks * kMinProgressChunkSize are split
+// into fewer chunks.
+constexpr size_t kMinProgressChunks = 16;
+constexpr size_t kMinProgressChunkSize = 16 * 1024;
+
+// SPI1D entries parsed between cancellation checks.
+constexpr int kCancelCheckEntries = 4096;
+
+inline bool IsCancelled(const LoadOptions &options, std::string *err) {
+  if (options.cancel && options.cancel->load()) {
+    if (err) {
+      (*err) = "LUT loading is cancelled.";
+    }
+    return true;
+  }
+  return false;
+}
+
+template <typename T>
+bool ParseSPI(const char *p, const char *end, const LoadOptions &options,
+              LUT3D<T> *lut, std::string *err) {
+  SPI3DHeader header;
+  if (!ParseSPI3DHeader(p, end, &header, err)) {
+    return false;
+  }
+
+  if (std::is_integral<T>::value &&
+      !CheckQuantizeRange(options.quantize_range[0],
+                          options.quantize_range[1], err)) {
+    return false;
+  }
+
+  // SPI3D files usually list entries with blue varying fastest. Storing
+  // them straight into the x-fastest LUT would touch a new cache line(and
+  // often a new page) per entry, so parse into a staging buffer in file
+  // order and transpose it afterwards.
+  const bool use_staging = IsBlueFastest(header.body, end);
+
+  // Bytes per entry alive at once: the LUT, the `written` flag, the staging
+  // buffer and the copy made when converting to bricks.
+  size_t entry_bytes = LayoutComponents(options.layout) * sizeof(T) + 1;
+  if (use_staging) {
+    entry_bytes += 3 * sizeof(float);
+  }
+  if (options.layout == LUT3DLayout::kBrickedRGBA) {
+    entry_bytes += LayoutComponents(options.layout) * sizeof(T);
+  }
+
+  const size_t dims[3] = {size_t(header.x_size), size_t(header.y_size),
+                          size_t(header.z_size)};
+  if (!CheckLUTSize(dims, 1, entry_bytes, options, err)) {
+    return false;
+  }
+
+  const size_t read_count = dims[0] * dims[1] * dims[2];
+
+  // Reject a body that cannot hold `read_count` entries before allocating.
+  if ((read_count - 1) > (size_t(end - header.body) / kMinSPI3DEntrySize)) {
+    if (err) {
+      (*err) = "LUT data is truncated. expected " +
+               std::to_string(read_count) + " entries but body is " +
+               std::to_string(end - header.body) + " bytes";
+    }
+    return false;
+  }
+
+  // Entries are written through row strides, which bricks do not have.
+  // Bricked LUTs are parsed padded and rearranged at the end.
+  const LUT3DLayout parse_layout =
+      (options.layout == LUT3DLayout::kBrickedRGBA) ? LUT3DLayout::kPaddedRGBA
+                                                    : options.layout;
+  // Every entry is written below(or loading fails), so skip zero-filling.
+  lut->create(dims[0], dims[1], dims[2], parse_layout, false);
+  SetQuantization(options, lut);
+  std::vector<std::atomic<uint8_t>> written(read_count);
+
+  std::vector<float, LUTAllocator<float>> staging;
+  SPI3DTarget<float> staging_target;
+  SPI3DTarget<T> lut_target;
+  for (int i = 0; i < 3; i++) {
+    staging_target.size[i] = int(dims[i]);
+    lut_target.size[i] = int(dims[i]);
+  }
+  staging_target.written = written.data();
+  lut_target.written = written.data();
+  if (use_staging) {
+    staging.resize(3 * read_count);
+    staging_target.data = staging.data();
+    staging_target.stride[0] = 3 * dims[1] * dims[2];
+    staging_target.stride[1] = 3 * dims[2];
+    staging_target.stride[2] = 3;
+  } else {
+    const size_t es = lut->entry_stride();
+    lut_target.data = lut->data_.data();
+    lut_target.stride[0] = es;
+    lut_target.stride[1] = es * dims[0];
+    lut_target.stride[2] = es * dims[0] * dims[1];
+    lut_target.component_stride = lut->component_stride();
+    lut_target.padded = (es == 4);
+    lut_target.encode.init(lut->offset_, lut->scale_);
+  }
+
+  size_t max_chunks = 1;
+  if (options.executor) {
+    // Let the executor balance the work.
+    max_chunks = 64;
+  } else if (options.num_threads != 1) {
+    size_t num_threads = options.num_threads;
+    if (num_threads == 0) {
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    max_chunks = 4 * num_threads;
+  }
+  size_t min_chunk_size = kMinParseChunkSize;
+  if (options.progress || options.cancel) {
+    // Report and check cancellation at a useful granularity.
+    max_chunks = std::max(max_chunks, kMinProgressChunks);
+    min_chunk_size = kMinProgressChunkSize;
+  }
+
+  std::vector<const char *> bounds =
+      SplitLines(header.body, end, max_chunks, min_chunk_size);
+  const size_t num_chunks = bounds.size() - 1;
+
+  // Entry lines carry their own indices, so chunks are independent.
+  std::vector<size_t> counts(num_chunks, 0);
+  std::vector<std::string> errs(num_chunks);
+  std::vector<char> oks(num_chunks, 0);
+
+  std::mutex progress_mutex;
+  size_t parsed_bytes = 0;
+  const size_t body_bytes = size_t(end - header.body);
+
+  ParallelFor(num_chunks, options, [&](size_t i) {
+    if (IsCancelled(options, &errs[i])) {
+      return;
+    }
+
+    oks[i] = use_staging
+                 ? ParseSPI3DEntries(bounds[i], bounds[i + 1], read_count,
+                                     staging_target, &counts[i], &errs[i])
+                 : ParseSPI3DEntries(bounds[i], bounds[i + 1], read_count,
+                                     lut_target, &counts[i], &errs[i]);
+
+    if (options.progress) {
+      std::lock_guard<std::mutex> lock(progress_mutex);
+      parsed_bytes += size_t(bounds[i + 1] - bounds[i]);
+      options.progress(body_bytes ? (float(parsed_bytes) / float(body_bytes))
+                                  : 1.0f);
+    }
+  });
+
+  size_t n = 0;
+  for (size_t i = 0; i < num_chunks; i++) {
+    if (!oks[i]) {
+      if (err) {
+        (*err) = errs[i];
+      }
+      return false;
+    }
+    n += counts[i];
+  }
+
+  if (n != read_count) {
+    if (err) {
+      if (n < read_count) {
+        (*err) = "LUT data is truncated. expected " +
+                 std::to_string(read_count) + " entries but got " +
+                 std::to_string(n);
+      } else {
+        (*err) = "Too many LUT entries. expected " +
+                 std::to_string(read_count);
+      }
+    }
+    return false;
+  }
+
+  // Entries are unique(see SPI3DTarget::written), so the right count means
+  // every entry is written.
+
+  if (use_staging) {
+    TransposeSPI3D(staging.data(), options, lut);
+  }
+  lut->convert(options.layout);
+
+  return true;
+}
+
+
+// Returns true when the first token of [p, end) equals `keyword`(case
+// insensitive) and advances `*pp` past it.
+inline bool ConsumeKeyword(const char **pp, const char *end,
+                           const char *keyword) {
+  const char *p = SkipSpaces(*pp, end);
+  size_t n = strlen(keyword);
+  if (size_t(end - p) < n) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    if (std::tolower(static_cast<unsigned char>(p[i])) != keyword[i]) {
+      return false;
+    }
+  }
+  if (((p + n) < end) && !IsWhitespace(p[n])) {
+    return false;
+  }
+  (*pp) = p + n;
+  return true;
+}
+
+struct SPI1DHeader {
+  int version{-1};
+  float from[2] = {0.0f, 1.0f};
+  int length{-1};
+  int components{1};
+  const char *body{nullptr};  // points just after '{'
+};
+
+bool ParseSPI1DHeader(const char *p, const char *end, SPI1DHeader *header,
+                      std::string *err) {
+  int version = -1;
+  float from[2] = {0.0f, 1.0f};
+  int length = -1;
+  int components = 1;
+
+  // Header lines until '{'.
+  while (true) {
+    p = SkipWhitespaces(p, end);
+    if (p == end) {
+      if (err) {
+        (*err) = "SPI1D data block '{' not found.";
+      }
+      return false;
+    }
+
+    const char *line = p;
+    const char *line_end = FindLineEnd(p, end);
+    bool ok = true;
+
+    if (*p == '{') {
+      p++;
+      break;
+    } else if (ConsumeKeyword(&p, line_end, "version")) {
+      ok = ParseInt(&p, line_end, &version);
+    } else if (ConsumeKeyword(&p, line_end, "from")) {
+      ok = ParseFloat(&p, line_end, &from[0]) &&
+           ParseFloat(&p, line_end, &from[1]);
+    } else if (ConsumeKeyword(&p, line_end, "length")) {
+      ok = ParseInt(&p, line_end, &length);
+    } else if (ConsumeKeyword(&p, line_end, "components")) {
+      ok = ParseInt(&p, line_end, &components);
+    } else if (version < 0) {
+      if (err) {
+        (*err) = "Not a SPI1D format. header = " + std::string(line, line_end);
+      }
+      return false;
+    }
+    // Unknown keywords after "Version" are ignored.
+
+    if (!ok) {
+      if (err) {
+        (*err) = "Failed to parse SPI1D header line : " +
+                 std::string(line, line_end);
+      }
+      return false;
+    }
+
+    p = SkipLine(p, end);
+  }
+
+  if (version != 1) {
+    if (err) {
+      (*err) = "Unsupported SPI1D version : " + std::to_string(version);
+    }
+    return false;
+  }
+
+  if (length <= 0) {
+    if (err) {
+      (*err) = "Invalid or missing SPI1D Length";
+    }
+    return false;
+  }
+
+  // 1(same curve for R, G and B) or 3(per channel curves). A 2 component
+  // table has no defined mapping to RGB.
+  if ((components != 1) && (components != 3)) {
+    if (err) {
+      (*err) = "Unsupported SPI1D Components : " + std::to_string(components);
+    }
+    return false;
+  }
+
+  header->version = version;
+  header->from[0] = from[0];
+  header->from[1] = from[1];
+  header->length = length;
+  header->components = components;
+  header->body = p;
+  return true;
+}
+
+template <typename T>
+bool ParseSPI(const char *p, const char *end, const LoadOptions &options,
+              LUT1D<T> *lut, std::string *err) {
+  SPI1DHeader header;
+  if (!ParseSPI1DHeader(p, end, &header, err)) {
+    return false;
+  }
+
+  const int length = header.length;
+  const int components = header.components;
+  p = header.body;
+
+  const size_t dims[3] = {size_t(length), 1, 1};
+  if (!CheckLUTSize(dims, size_t(components), sizeof(T), options, err)) {
+    return false;
+  }
+
+  // Each value takes at least one digit and one separator.
+  if ((size_t(length) * size_t(components)) > (size_t(end - p) / 2)) {
+    if (err) {
+      (*err) = "SPI1D data is truncated. expected " + std::to_string(length) +
+               " entries but body is " + std::to_string(end - p) + " bytes";
+    }
+    return false;
+  }
+
+  // Every value is written below(or loading fails).
+  lut->create(size_t(length), size_t(components),
+              {{header.from[0], header.from[1]}}, false);
+
+  T *dst = lut->data_.data();
+  for (int i = 0; i < length; i++) {
+    if (((i % kCancelCheckEntries) == 0) && IsCancelled(options, err)) {
+      return false;
+    }
+
+    p = SkipWhitespaces(p, end);
+
+    const char *line = p;
+    for (int c = 0; c < components; c++) {
+      float v;
+      if (!ParseFloat(&p, end, &v)) {
+        if (err) {
+          (*err) = ((p < end) && (*line != '}'))
+                       ? ("Failed to parse SPI1D entry : " +
+                          std::string(line, FindLineEnd(line, end)))
+                       : ("SPI1D data is truncated. expected " +
+                          std::to_string(length) + " entries but got " +
+                          std::to_string(i));
+        }
+        return false;
+      }
+      dst[c] = T(v);
+    }
+
+    p = SkipSpaces(p, end);
+    if ((p < end) && (*p != '\n')) {
+      if (err) {
+        (*err) = "Unexpected character in SPI1D entry : " +
+                 std::string(line, FindLineEnd(line, end));
+      }
+      return false;
+    }
+
+    dst += components;
+  }
+
+  p = SkipWhitespaces(p, end);
+  if ((p == end) || (*p != '}')) {
+    if (err) {
+      (*err) = "SPI1D data block is not closed with '}'. expected " +
+               std::to_string(length) + " entries";
+    }
+    return false;
+  }
+
+  return true;
+}
+
+}  // namespace
+
+bool MappedFile::open(const std::string &filename, std::string *err) {
+  close();
+
+#if !defined(_WIN32) && !defined(TINY_COLOR_IO_NO_MMAP)
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    if (err) {
+      (*err) = "Failed to open file : " + filename;
+    }
+    return false;
+  }
+
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+    ::close(fd);
+    if (err) {
+      (*err) = "Not a regular file : " + filename;
+    }
+    return false;
+  }
+
+  size_ = size_t(st.st_size);
+  if (size_ > 0) {
+    void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      ::close(fd);
+      size_ = 0;
+      if (err) {
+        (*err) = "Failed to mmap file : " + filename;
+      }
+      return false;
+    }
+    // We scan the file front to back exactly once.
+    madvise(addr, size_, MADV_SEQUENTIAL);
+    mapped_ = addr;
+    data_ = static_cast<const char *>(addr);
+  }
+  ::close(fd);
+  return true;
+#else
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    if (err) {
+      (*err) = "Failed to open file : " + filename;
+    }
+    return false;
+  }
+
+  ifs.seekg(0, ifs.end);
+  std::streamoff sz = ifs.tellg();
+  ifs.seekg(0, ifs.beg);
+  if (sz < 0) {
+    if (err) {
+      (*err) = "Failed to read file : " + filename;
+    }
+    return false;
+  }
+
+  buf_.resize(size_t(sz));
+  if (sz > 0) {
+    ifs.read(buf_.data(), sz);
+  }
+  data_ = buf_.data();
+  size_ = buf_.size();
+  return true;
+#endif
+}
+
+void MappedFile::close() {
+#if !defined(_WIN32) && !defined(TINY_COLOR_IO_NO_MMAP)
+  if (mapped_) {
+    munmap(mapped_, size_);
+  }
+  mapped_ = nullptr;
+#endif
+  buf_.clear();
+  data_ = nullptr;
+  size_ = 0;
+}
+
+namespace {
+
+template <typename LUT>
+bool LoadSPIFromFile(const std::string &filename, LUT *lut,
+                     const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  MappedFile file;
+  if (!file.open(filename, err)) {
+    return false;
+  }
+
+  return ParseSPI(file.data(), file.data() + file.size(), options, lut, err);
+}
+
+template <typename LUT>
+bool LoadSPIFromMemory(const char *data, size_t len, LUT *lut,
+                       const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  if (!data && (len > 0)) {
+    if (err) {
+      (*err) = "`data` argument is nullptr";
+    }
+    return false;
+  }
+
+  return ParseSPI(data, data + len, options, lut, err);
+}
+
+}  // namespace
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Df *lut,
+                       std::string *err) {
+  return LoadSPIFromFile(filename, lut, LoadOptions(), err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Df *lut,
+                       const LoadOptions &options, std::string *err) {
+  return LoadSPIFromFile(filename, lut, options, err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Df *lut,
+                         std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, LoadOptions(), err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Df *lut,
+                         const LoadOptions &options, std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, options, err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
+                       std::string *err) {
+  return LoadSPIFromFile(filename, lut, LoadOptions(), err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Df *lut,
+                       const LoadOptions &options, std::string *err) {
+  return LoadSPIFromFile(filename, lut, options, err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Df *lut,
+                         std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, LoadOptions(), err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Df *lut,
+                         const LoadOptions &options, std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, options, err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT1Dh *lut,
+                       const LoadOptions &options, std::string *err) {
+  return LoadSPIFromFile(filename, lut, options, err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Dh *lut,
+                       const LoadOptions &options, std::string *err) {
+  return LoadSPIFromFile(filename, lut, options, err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT1Dh *lut,
+                         const LoadOptions &options, std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, options, err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Dh *lut,
+                         const LoadOptions &options, std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, options, err);
+}
+
+bool LoadSPI3DFromFile(const std::string &filename, LUT3Du16 *lut,
+                       const LoadOptions &options, std::string *err) {
+  return LoadSPIFromFile(filename, lut, options, err);
+}
+
+bool LoadSPI3DFromMemory(const char *data, size_t len, LUT3Du16 *lut,
+                         const LoadOptions &options, std::string *err) {
+  return LoadSPIFromMemory(data, len, lut, options, err);
+}
+
+//
+// Binary LUT container
+//
+
+namespace {
+
+const char kLUTBinaryMagic[8] = {'T', 'C', 'I', 'O', 'L', 'U', 'T', '\0'};
+
+inline bool IsLittleEndian() {
+  const uint32_t v = 1;
+  uint8_t b;
+  memcpy(&b, &v, 1);
+  return b == 1;
+}
+
+inline size_t ElementSize(uint32_t element_type) {
+  switch (LUTElementType(element_type)) {
+    case LUTElementType::kFloat32:
+      return sizeof(float);
+  }
+  return 0;
+}
+
+bool ValidateLUTBinaryHeader(const LUTBinaryHeader &h, uint64_t file_size,
+                             std::string *err) {
+  if (memcmp(h.magic, kLUTBinaryMagic, sizeof(kLUTBinaryMagic)) != 0) {
+    if (err) {
+      (*err) = "Not a binary LUT container.";
+    }
+    return false;
+  }
+
+  if (!IsLittleEndian()) {
+    if (err) {
+      (*err) = "Binary LUT container is only supported on little endian.";
+    }
+    return false;
+  }
+
+  if (h.version != kLUTBinaryVersion) {
+    if (err) {
+      (*err) = "Unsupported binary LUT version : " + std::to_string(h.version);
+    }
+    return false;
+  }
+
+  size_t elem_size = ElementSize(h.element_type);
+  if ((h.header_size != sizeof(LUTBinaryHeader)) || (elem_size == 0) ||
+      ((h.num_dims != 1) && (h.num_dims != 3)) || (h.components == 0) ||
+      (h.components > 4) || (h.dims[0] == 0) || (h.dims[1] == 0) ||
+      (h.dims[2] == 0) || ((h.payload_offset % kLUTBinaryAlignment) != 0) ||
+      // Loaders size 1D tables by dims[0] and 3D tables by 3 components.
+      ((h.num_dims == 1) && ((h.dims[1] != 1) || (h.dims[2] != 1))) ||
+      ((h.num_dims == 3) && (h.components != 3)) ||
+      (h.layout_flags > kLUTLayoutBrickedRGBA) ||
+      ((h.layout_flags != kLUTLayoutInterleaved) &&
+       ((h.num_dims != 3) || (h.components != 3)))) {
+    if (err) {
+      (*err) = "Invalid binary LUT header.";
+    }
+    return false;
+  }
+
+  // Overflow-safe payload size check. Bricked payload counts whole bricks.
+  const bool bricked = (h.layout_flags == kLUTLayoutBrickedRGBA);
+  const uint64_t B = kLUT3DBrickSize;
+  uint64_t count = bricked ? (4 * B * B * B)
+                           : ((h.layout_flags == kLUTLayoutPaddedRGBA)
+                                  ? 4
+                                  : h.components);
+  for (int i = 0; i < 3; i++) {
+    const uint64_t n =
+        bricked ? ((h.dims[i] / B) + ((h.dims[i] % B) ? 1 : 0)) : h.dims[i];
+    if (count > (std::numeric_limits<uint64_t>::max() / n)) {
+      count = 0;
+      break;
+    }
+    count *= n;
+  }
+  if ((count == 0) ||
+      (count > (std::numeric_limits<uint64_t>::max() / elem_size)) ||
+      (count * elem_size != h.payload_size) ||
+      (h.payload_offset > file_size) ||
+      (h.payload_size > (file_size - h.payload_offset)) ||
+      (h.payload_size > std::numeric_limits<size_t>::max())) {
+    if (err) {
+      (*err) = "Binary LUT payload size mismatch.";
+    }
+    return false;
+  }
+
+  return true;
+}
+
+bool WriteLUTBinary(const std::string &filename, LUTBinaryHeader header,
+                    const void *payload, std::string *err) {
+  if (!IsLittleEndian()) {
+    if (err) {
+      (*err) = "Binary LUT container is only supported on little endian.";
+    }
+    return false;
+  }
+
+  memcpy(header.magic, kLUTBinaryMagic, sizeof(kLUTBinaryMagic));
+  header.version = kLUTBinaryVersion;
+  header.header_size = uint32_t(sizeof(LUTBinaryHeader));
+  header.payload_offset = sizeof(LUTBinaryHeader);
+  header.payload_checksum =
+      LUTBinaryChecksum(payload, size_t(header.payload_size));
+  memset(header.reserved, 0, sizeof(header.reserved));
+
+  std::ofstream ofs(filename, std::ios::binary);
+  if (!ofs) {
+    if (err) {
+      (*err) = "Failed to open file for writing : " + filename;
+    }
+    return false;
+  }
+
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(static_cast<const char *>(payload),
+            std::streamsize(header.payload_size));
+
+  if (!ofs) {
+    if (err) {
+      (*err) = "Failed to write file : " + filename;
+    }
+    return false;
+  }
+
+  return true;
+}
+
+bool CheckPayload(const char *data, const LUTBinaryHeader &header,
+                  std::string *err) {
+  if (LUTBinaryChecksum(data + header.payload_offset,
+                        size_t(header.payload_size)) !=
+      header.payload_checksum) {
+    if (err) {
+      (*err) = "Binary LUT payload checksum mismatch.";
+    }
+    return false;
+  }
+  return true;
+}
+
+// Guards the payload copy against a table allocated from inconsistent
+// header dims.
+bool CheckPayloadSize(size_t num_values, const LUTBinaryHeader &header,
+                      std::string *err) {
+  if ((num_values * sizeof(float)) != header.payload_size) {
+    if (err) {
+      (*err) = "Binary LUT payload size does not match its dimensions.";
+    }
+    return false;
+  }
+  return true;
+}
+
+bool CopyLUTBinary(const char *data, const LUTBinaryHeader &header,
+                   const LoadOptions &options, LUT3Df *lut, std::string *err) {
+  if ((header.num_dims != 3) || (header.components != 3) ||
+      (header.element_type != uint32_t(LUTElementType::kFloat32))) {
+    if (err) {
+      (*err) = "Binary LUT is not a float RGB 3D LUT.";
+    }
+    return false;
+  }
+
+  const LUT3DLayout layout = LUT3DLayout(header.layout_flags);
+  const size_t dims[3] = {size_t(header.dims[0]), size_t(header.dims[1]),
+                          size_t(header.dims[2])};
+  if (!CheckLUTSize(dims, LayoutComponents(layout), sizeof(float), options,
+                    err) ||
+      ((layout != options.layout) &&
+       !CheckLUTSize(dims, LayoutComponents(options.layout), sizeof(float),
+                     options, err)) ||
+      IsCancelled(options, err) || !CheckPayload(data, header, err) ||
+      IsCancelled(options, err)) {
+    return false;
+  }
+
+  lut->create(dims[0], dims[1], dims[2], layout, false);
+  if (!CheckPayloadSize(lut->data_.size(), header, err)) {
+    return false;
+  }
+  memcpy(lut->data_.data(), data + header.payload_offset,
+         size_t(header.payload_size));
+  if ((layout != options.layout) && IsCancelled(options, err)) {
+    return false;
+  }
+  lut->convert(options.layout);
+  return true;
+}
+
+bool CopyLUTBinary(const char *data, const LUTBinaryHeader &header,
+                   const LoadOptions &options, LUT1Df *lut, std::string *err) {
+  if ((header.num_dims != 1) ||
+      (header.element_type != uint32_t(LUTElementType::kFloat32))) {
+    if (err) {
+      (*err) = "Binary LUT is not a float 1D LUT.";
+    }
+    return false;
+  }
+
+  // The table is sized by dims[0] alone.
+  const size_t dims[3] = {size_t(header.dims[0]), 1, 1};
+  if (!CheckLUTSize(dims, header.components, sizeof(float), options, err) ||
+      IsCancelled(options, err) || !CheckPayload(data, header, err) ||
+      IsCancelled(options, err)) {
+    return false;
+  }
+
+  lut->create(size_t(header.dims[0]), size_t(header.components),
+              {{header.x_range[0], header.x_range[1]}}, false);
+  if (!CheckPayloadSize(lut->data_.size(), header, err)) {
+    return false;
+  }
+  memcpy(lut->data_.data(), data + header.payload_offset,
+         size_t(header.payload_size));
+  return true;
+}
+
+bool IsPayloadAligned(const char *data, const LUTBinaryHeader &header,
+                      std::string *err) {
+  if ((reinterpret_cast<uintptr_t>(data + header.payload_offset) %
+       alignof(float)) != 0) {
+    if (err) {
+      (*err) = "Binary LUT payload is not aligned.";
+    }
+    return false;
+  }
+  return true;
+}
+
+bool MakeLUTBinaryView(const char *data, const LUTBinaryHeader &header,
+                       LUT3DViewf *lut, std::string *err) {
+  if ((header.num_dims != 3) || (header.components != 3) ||
+      (header.element_type != uint32_t(LUTElementType::kFloat32))) {
+    if (err) {
+      (*err) = "Binary LUT is not a float RGB 3D LUT.";
+    }
+    return false;
+  }
+  if (!IsPayloadAligned(data, header, err)) {
+    return false;
+  }
+
+  // The header validation matched the payload size against the layout.
+  (*lut) = LUT3DViewf(
+      reinterpret_cast<const float *>(data + header.payload_offset),
+      size_t(header.dims[0]), size_t(header.dims[1]), size_t(header.dims[2]),
+      LUT3DLayout(header.layout_flags));
+  return true;
+}
+
+bool MakeLUTBinaryView(const char *data, const LUTBinaryHeader &header,
+                       LUT1DViewf *lut, std::string *err) {
+  if ((header.num_dims != 1) ||
+      (header.element_type != uint32_t(LUTElementType::kFloat32))) {
+    if (err) {
+      (*err) = "Binary LUT is not a float 1D LUT.";
+    }
+    return false;
+  }
+  if (!IsPayloadAligned(data, header, err)) {
+    return false;
+  }
+
+  (*lut) = LUT1DViewf(
+      reinterpret_cast<const float *>(data + header.payload_offset),
+      size_t(header.dims[0]), size_t(header.components),
+      {{header.x_range[0], header.x_range[1]}});
+  return true;
+}
+
+}  // namespace
+
+uint64_t LUTBinaryChecksum(const void *data, size_t len) {
+  const char *p = static_cast<const char *>(data);
+
+  // Two running sums over 64-bit little endian words(zero padded tail).
+  uint64_t a = 0x9e3779b97f4a7c15ULL, b = len;
+  size_t i = 0;
+  for (; (i + 8) <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    a += w;
+    b += a;
+  }
+  if (i < len) {
+    uint64_t w = 0;
+    memcpy(&w, p + i, len - i);
+    a += w;
+    b += a;
+  }
+
+  return a ^ (b << 1) ^ (b >> 63);
+}
+
+bool ParseLUTBinaryHeader(const char *data, size_t len,
+                          LUTBinaryHeader *header, std::string *err) {
+  if (!data || (len < sizeof(LUTBinaryHeader))) {
+    if (err) {
+      (*err) = "Binary LUT is too small.";
+    }
+    return false;
+  }
+
+  LUTBinaryHeader h;
+  memcpy(&h, data, sizeof(h));
+
+  if (!ValidateLUTBinaryHeader(h, len, err)) {
+    return false;
+  }
+
+  (*header) = h;
+  return true;
+}
+
+bool SaveLUTBinaryToFile(const std::string &filename, const LUT3Df &lut,
+                         std::string *err) {
+  LUTBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  header.num_dims = 3;
+  header.element_type = uint32_t(LUTElementType::kFloat32);
+  header.components = 3;
+  header.layout_flags = uint32_t(lut.layout());
+  header.dims[0] = lut.x_dim();
+  header.dims[1] = lut.y_dim();
+  header.dims[2] = lut.z_dim();
+  header.x_range[0] = 0.0f;
+  header.x_range[1] = 1.0f;
+  header.payload_size = lut.data_.size() * sizeof(float);
+
+  return WriteLUTBinary(filename, header, lut.data_.data(), err);
+}
+
+bool SaveLUTBinaryToFile(const std::string &filename, const LUT1Df &lut,
+                         std::string *err) {
+  LUTBinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  header.num_dims = 1;
+  header.element_type = uint32_t(LUTElementType::kFloat32);
+  header.components = uint32_t(lut.components_);
+  header.layout_flags = kLUTLayoutInterleaved;
+  header.dims[0] = lut.length();
+  header.dims[1] = 1;
+  header.dims[2] = 1;
+  header.x_range[0] = lut.x_range_[0];
+  header.x_range[1] = lut.x_range_[1];
+  header.payload_size = lut.data_.size() * sizeof(float);
+
+  return WriteLUTBinary(filename, header, lut.data_.data(), err);
+}
+
+bool LUTBinaryFile::open(const std::string &filename, std::string *err,
+                         bool verify_checksum) {
+  if (!file_.open(filename, err)) {
+    return false;
+  }
+
+  if (!ParseLUTBinaryHeader(file_.data(), file_.size(), &header_, err) ||
+      (verify_checksum && !CheckPayload(file_.data(), header_, err))) {
+    file_.close();
+    return false;
+  }
+
+  return true;
+}
+
+bool LUTBinaryFile::view(LUT3DViewf *lut, std::string *err) const {
+  if (!lut || !file_.data()) {
+    if (err) {
+      (*err) = "Binary LUT file is not open or `lut` is nullptr.";
+    }
+    return false;
+  }
+  return MakeLUTBinaryView(file_.data(), header_, lut, err);
+}
+
+bool LUTBinaryFile::view(LUT1DViewf *lut, std::string *err) const {
+  if (!lut || !file_.data()) {
+    if (err) {
+      (*err) = "Binary LUT file is not open or `lut` is nullptr.";
+    }
+    return false;
+  }
+  return MakeLUTBinaryView(file_.data(), header_, lut, err);
+}
+
+bool ViewLUTBinaryFromMemory(const char *data, size_t len, LUT3DViewf *lut,
+                             std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  LUTBinaryHeader header;
+  if (!ParseLUTBinaryHeader(data, len, &header, err)) {
+    return false;
+  }
+  return MakeLUTBinaryView(data, header, lut, err);
+}
+
+bool ViewLUTBinaryFromMemory(const char *data, size_t len, LUT1DViewf *lut,
+                             std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  LUTBinaryHeader header;
+  if (!ParseLUTBinaryHeader(data, len, &header, err)) {
+    return false;
+  }
+  return MakeLUTBinaryView(data, header, lut, err);
+}
+
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT3Df *lut,
+                           std::string *err) {
+  return LoadLUTBinaryFromFile(filename, lut, LoadOptions(), err);
+}
+
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT3Df *lut,
+                           const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  MappedFile file;
+  if (!file.open(filename, err)) {
+    return false;
+  }
+
+  return LoadLUTBinaryFromMemory(file.data(), file.size(), lut, options,
+                                 err);
+}
+
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT1Df *lut,
+                           std::string *err) {
+  return LoadLUTBinaryFromFile(filename, lut, LoadOptions(), err);
+}
+
+bool LoadLUTBinaryFromFile(const std::string &filename, LUT1Df *lut,
+                           const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  MappedFile file;
+  if (!file.open(filename, err)) {
+    return false;
+  }
+
+  return LoadLUTBinaryFromMemory(file.data(), file.size(), lut, options,
+                                 err);
+}
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT3Df *lut,
+                             std::string *err) {
+  return LoadLUTBinaryFromMemory(data, len, lut, LoadOptions(), err);
+}
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT3Df *lut,
+                             const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  LUTBinaryHeader header;
+  if (!ParseLUTBinaryHeader(data, len, &header, err)) {
+    return false;
+  }
+  return CopyLUTBinary(data, header, options, lut, err);
+}
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT1Df *lut,
+                             std::string *err) {
+  return LoadLUTBinaryFromMemory(data, len, lut, LoadOptions(), err);
+}
+
+bool LoadLUTBinaryFromMemory(const char *data, size_t len, LUT1Df *lut,
+                             const LoadOptions &options, std::string *err) {
+  if (!lut) {
+    if (err) {
+      (*err) = "`lut` argument is nullptr";
+    }
+    return false;
+  }
+
+  LUTBinaryHeader header;
+  if (!ParseLUTBinaryHeader(data, len, &header, err)) {
+    return false;
+  }
+  return CopyLUTBinary(data, header, options, lut, err);
+}
+
+
+//
+// Probe
+//
+
+namespace {
+
+// Bytes read by ProbeLUTFile().
+constexpr size_t kProbeSize = 4096;
+
+bool ProbeLUT(const char *data, size_t len, uint64_t total_size,
+              LUTInfo *info, std::string *err) {
+  LUTInfo result;
+
+  if ((len >= sizeof(kLUTBinaryMagic)) &&
+      (memcmp(data, kLUTBinaryMagic, sizeof(kLUTBinaryMagic)) == 0)) {
+    if (len < sizeof(LUTBinaryHeader)) {
+      if (err) {
+        (*err) = "Binary LUT is too small.";
+      }
+      return false;
+    }
+
+    LUTBinaryHeader h;
+    memcpy(&h, data, sizeof(h));
+    if (!ValidateLUTBinaryHeader(h, total_size, err)) {
+      return false;
+    }
+
+    result.format = LUTFormat::kBinary;
+    result.num_dims = h.num_dims;
+    result.dims[0] = size_t(h.dims[0]);
+    result.dims[1] = size_t(h.dims[1]);
+    result.dims[2] = size_t(h.dims[2]);
+    result.components = h.components;
+    result.element_type = LUTElementType(h.element_type);
+    result.data_size = size_t(h.payload_size);
+    (*info) = result;
+    return true;
+  }
+
+  // Only look at complete lines of a partial read.
+  const char *end = data + len;
+  if (len < total_size) {
+    while ((end > data) && (end[-1] != '\n')) {
+      end--;
+    }
+  }
+
+  const char *p = SkipWhitespaces(data, end);
+  if (ContainsNoCase(p, FindLineEnd(p, end), "spilut")) {
+    SPI3DHeader h;
+    if (!ParseSPI3DHeader(p, end, &h, err)) {
+      return false;
+    }
+
+    result.format = LUTFormat::kSPI3D;
+    result.num_dims = 3;
+    result.dims[0] = size_t(h.x_size);
+    result.dims[1] = size_t(h.y_size);
+    result.dims[2] = size_t(h.z_size);
+    result.components = 3;
+  } else {
+    SPI1DHeader h;
+    if (!ParseSPI1DHeader(p, end, &h, err)) {
+      if (err) {
+        (*err) = "Unknown LUT format. " + (*err);
+      }
+      return false;
+    }
+
+    result.format = LUTFormat::kSPI1D;
+    result.num_dims = 1;
+    result.dims[0] = size_t(h.length);
+    result.dims[1] = 1;
+    result.dims[2] = 1;
+    result.components = size_t(h.components);
+  }
+
+  size_t count = result.components;
+  if (!MulSize(count, result.dims[0], &count) ||
+      !MulSize(count, result.dims[1], &count) ||
+      !MulSize(count, result.dims[2], &count) ||
+      !MulSize(count, sizeof(float), &result.data_size)) {
+    if (err) {
+      (*err) = "LUT size overflows.";
+    }
+    return false;
+  }
+
+  (*info) = result;
+  return true;
+}
+
+}  // namespace
+
+bool ProbeLUTMemory(const char *data, size_t len, LUTInfo *info,
+                    std::string *err) {
+  if (!info) {
+    if (err) {
+      (*err) = "`info` argument is nullptr";
+    }
+    return false;
+  }
+
+  if (!data && (len > 0)) {
+    if (err) {
+      (*err) = "`data` argument is nullptr";
+    }
+    return false;
+  }
+
+  return ProbeLUT(data, len, len, info, err);
+}
+
+bool ProbeLUTFile(const std::string &filename, LUTInfo *info,
+                  std::string *err) {
+  if (!info) {
+    if (err) {
+      (*err) = "`info` argument is nullptr";
+    }
+    return false;
+  }
+
+  std::ifstream ifs(filename, std::ios::binary);
+  if (!ifs) {
+    if (err) {
+      (*err) = "Failed to open file : " + filename;
+    }
+    return false;
+  }
+
+  ifs.seekg(0, ifs.end);
+  std::streamoff sz = ifs.tellg();
+  ifs.seekg(0, ifs.beg);
+  if (sz < 0) {
+    if (err) {
+      (*err) = "Failed to read file : " + filename;
+    }
+    return false;
+  }
+
+  char buf[kProbeSize];
+  size_t len = std::min(size_t(sz), kProbeSize);
+  ifs.read(buf, std::streamsize(len));
+  if (size_t(ifs.gcount()) != len) {
+    if (err) {
+      (*err) = "Failed to read file : " + filename;
+    }
+    return false;
+  }
+
+  return ProbeLUT(buf, len, uint64_t(sz), info, err);
+}
+
+
+
+//
+// Evaluation
+//
+
+namespace {
+
+// Integer cell and fraction of `v`(clamped to [0, 1]) along an axis of
+// `dim` samples.
+inline void LUTCoord(float v, size_t dim, size_t *i0, size_t *i1,
+                     float *f) {
+  if (!(v > 0.0f)) {
+    v = 0.0f;  // also handles NaN
+  } else if (v > 1.0f) {
+    v = 1.0f;
+  }
+
+  const float p = (dim > 1) ? (v * float(dim - 1)) : 0.0f;
+  size_t i = size_t(p);
+  if ((i + 1) >= dim) {
+    i = (dim > 1) ? (dim - 2) : 0;
+  }
+  (*i0) = i;
+  (*i1) = (dim > 1) ? (i + 1) : 0;
+  (*f) = (dim > 1) ? (p - float(i)) : 0.0f;
+}
+
+template <typename T>
+inline bool IsEmptyLUT(const LUT3DView<T> &lut) {
+  return (lut.data_ == nullptr) || (lut.x_dim_ == 0) || (lut.y_dim_ == 0) ||
+         (lut.z_dim_ == 0);
+}
+
+// Entry indices of the 8 cell corners(x fastest within each pair).
+struct LUTCell {
+  size_t idx[8];  // (x0,y0,z0), (x1,y0,z0), (x0,y1,z0), ... (x1,y1,z1)
+  float fx, fy, fz;
+};
+
+template <typename T>
+inline void LUTCellAt(const LUT3DView<T> &lut, const float rgb[3],
+                      LUTCell *cell) {
+  size_t x0, x1, y0, y1, z0, z1;
+  LUTCoord(rgb[0], lut.x_dim_, &x0, &x1, &cell->fx);
+  LUTCoord(rgb[1], lut.y_dim_, &y0, &y1, &cell->fy);
+  LUTCoord(rgb[2], lut.z_dim_, &z0, &z1, &cell->fz);
+
+  // LUT3D::index() is a sum of per axis terms in every layout.
+  x0 = lut.index(x0, 0, 0);
+  x1 = lut.index(x1, 0, 0);
+  const size_t y_0 = lut.index(0, y0, 0);
+  const size_t y_1 = lut.index(0, y1, 0);
+  const size_t z_0 = lut.index(0, 0, z0);
+  const size_t z_1 = lut.index(0, 0, z1);
+  const size_t r0 = y_0 + z_0;
+  const size_t r1 = y_1 + z_0;
+  const size_t r2 = y_0 + z_1;
+  const size_t r3 = y_1 + z_1;
+  cell->idx[0] = r0 + x0;
+  cell->idx[1] = r0 + x1;
+  cell->idx[2] = r1 + x0;
+  cell->idx[3] = r1 + x1;
+  cell->idx[4] = r2 + x0;
+  cell->idx[5] = r2 + x1;
+  cell->idx[6] = r3 + x0;
+  cell->idx[7] = r3 + x1;
+}
+
+inline float Lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+// Cell of `rgb` in a LUT3DCells and the fractions within it.
+template <typename T>
+inline const T *CellAt(const LUT3DCells<T> &cells, const float rgb[3],
+                       float f[3]) {
+  size_t x, y, z, unused;
+  LUTCoord(rgb[0], cells.x_dim_, &x, &unused, &f[0]);
+  LUTCoord(rgb[1], cells.y_dim_, &y, &unused, &f[1]);
+  LUTCoord(rgb[2], cells.z_dim_, &z, &unused, &f[2]);
+  const size_t i = (z * cells.y_cells() + y) * cells.x_cells() + x;
+  return cells.data_.data() + LUT3DCells<T>::kCellSize * i;
+}
+
+// z, then y, then x, the same order as the SIMD path.
+template <typename T>
+void EvalCellScalar(const T *d, const float f[3], float out[3]) {
+  for (size_t c = 0; c < 3; c++) {
+    const T *v = d + 8 * c;
+    const float v00 = Lerp(float(v[0]), float(v[4]), f[2]);
+    const float v10 = Lerp(float(v[1]), float(v[5]), f[2]);
+    const float v01 = Lerp(float(v[2]), float(v[6]), f[2]);
+    const float v11 = Lerp(float(v[3]), float(v[7]), f[2]);
+    out[c] = Lerp(Lerp(v00, v01, f[1]), Lerp(v10, v11, f[1]), f[0]);
+  }
+}
+
+// Layout independent path.
+template <typename T>
+void EvalTrilinearScalar(const LUT3DView<T> &lut, const LUTCell &cell,
+                         float scale, float offset, float out[3]) {
+  for (size_t c = 0; c < 3; c++) {
+    float v[8];
+    for (int k = 0; k < 8; k++) {
+      v[k] = float(lut.data_[lut.offset(cell.idx[k], c)]);
+    }
+    const float v00 = Lerp(v[0], v[1], cell.fx);
+    const float v10 = Lerp(v[2], v[3], cell.fx);
+    const float v01 = Lerp(v[4], v[5], cell.fx);
+    const float v11 = Lerp(v[6], v[7], cell.fx);
+    const float v0 = Lerp(v00, v10, cell.fy);
+    const float v1 = Lerp(v01, v11, cell.fy);
+    out[c] = Lerp(v0, v1, cell.fz) * scale + offset;
+  }
+}
+
+// Tetrahedron of `cell` containing the sample. Its corners are LUTCell::idx
+// 0, `*b`, `*c` and 7(x, y and z are bits 0, 1 and 2 of a corner number),
+// reached by stepping along the axes in order of decreasing fraction `f`.
+// Branchless: the tetrahedron is data dependent and mispredicts on real
+// images.
+inline void LUTTetrahedron(const LUTCell &cell, int *b, int *c, float f[3]) {
+  const float fx = cell.fx;
+  const float fy = cell.fy;
+  const float fz = cell.fz;
+
+  // Ties go to the later axis, which keeps the order total.
+  const int xy = (fx > fy);   // x before y
+  const int yz = (fy > fz);   // y before z
+  const int zx = (fz >= fx);  // z before x
+
+  // First axis, then first two axes.
+  (*b) = (xy & (zx ^ 1)) | (((xy ^ 1) & yz) << 1) | ((zx & (yz ^ 1)) << 2);
+  (*c) = (xy | (zx ^ 1)) | (((xy ^ 1) | yz) << 1) | ((zx | (yz ^ 1)) << 2);
+
+  const float lo = std::min(fx, fy);
+  const float hi = std::max(fx, fy);
+  f[0] = std::max(hi, fz);
+  f[1] = std::max(lo, std::min(hi, fz));
+  f[2] = std::min(lo, fz);
+}
+
+template <typename T>
+void EvalTetrahedralScalar(const LUT3DView<T> &lut, const LUTCell &cell,
+                           float scale, float offset, float out[3]) {
+  int b, c;
+  float f[3];
+  LUTTetrahedron(cell, &b, &c, f);
+  for (size_t i = 0; i < 3; i++) {
+    const float v0 = float(lut.data_[lut.offset(cell.idx[0], i)]);
+    const float vb = float(lut.data_[lut.offset(cell.idx[b], i)]);
+    const float vc = float(lut.data_[lut.offset(cell.idx[c], i)]);
+    const float v7 = float(lut.data_[lut.offset(cell.idx[7], i)]);
+    out[i] = (v0 + (vb - v0) * f[0] + (vc - vb) * f[1] + (v7 - vc) * f[2]) *
+                 scale +
+             offset;
+  }
+}
+
+#if defined(TINYCOLORIO_USE_SSE2)
+
+inline __m128 Lerp4(__m128 a, __m128 b, __m128 t) {
+  return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+// Trilinear blend of 8 corners held in SSE registers.
+inline __m128 Trilinear4(const __m128 c[8], const LUTCell &cell) {
+  const __m128 fx = _mm_set1_ps(cell.fx);
+  const __m128 fy = _mm_set1_ps(cell.fy);
+  const __m128 fz = _mm_set1_ps(cell.fz);
+  const __m128 v00 = Lerp4(c[0], c[1], fx);
+  const __m128 v10 = Lerp4(c[2], c[3], fx);
+  const __m128 v01 = Lerp4(c[4], c[5], fx);
+  const __m128 v11 = Lerp4(c[6], c[7], fx);
+  return Lerp4(Lerp4(v00, v10, fy), Lerp4(v01, v11, fy), fz);
+}
+
+// Tetrahedral blend of 8 corners held in SSE registers. Same tetrahedron,
+// weights and result as LUTTetrahedron() and EvalTetrahedralScalar(), but
+// corners b and c are selected with masks: loading only 4 corners makes the
+// load addresses depend on the fractions, which is slower than 8 loads.
+inline __m128 Tetrahedral4(const __m128 c[8], const LUTCell &cell) {
+  const __m128 fx = _mm_set1_ps(cell.fx);
+  const __m128 fy = _mm_set1_ps(cell.fy);
+  const __m128 fz = _mm_set1_ps(cell.fz);
+  const __m128 xy = _mm_cmpgt_ps(fx, fy);
+  const __m128 yz = _mm_cmpgt_ps(fy, fz);
+  const __m128 zx = _mm_cmpge_ps(fz, fx);
+
+  // b: corner of the first axis.
+  const __m128 cb = _mm_or_ps(
+      _mm_or_ps(_mm_and_ps(_mm_andnot_ps(zx, xy), c[1]),
+                _mm_and_ps(_mm_andnot_ps(xy, yz), c[2])),
+      _mm_and_ps(_mm_andnot_ps(yz, zx), c[4]));
+
+  // c: all axes but the last one.
+  const __m128 cc = _mm_or_ps(
+      _mm_or_ps(_mm_and_ps(_mm_andnot_ps(xy, zx), c[6]),
+                _mm_and_ps(_mm_andnot_ps(yz, xy), c[5])),
+      _mm_and_ps(_mm_andnot_ps(zx, yz), c[3]));
+
+  const __m128 lo = _mm_min_ps(fx, fy);
+  const __m128 hi = _mm_max_ps(fx, fy);
+  const __m128 f0 = _mm_max_ps(hi, fz);
+  const __m128 f1 = _mm_max_ps(lo, _mm_min_ps(hi, fz));
+  const __m128 f2 = _mm_min_ps(lo, fz);
+
+  __m128 v = _mm_add_ps(c[0], _mm_mul_ps(_mm_sub_ps(cb, c[0]), f0));
+  v = _mm_add_ps(v, _mm_mul_ps(_mm_sub_ps(cc, cb), f1));
+  return _mm_add_ps(v, _mm_mul_ps(_mm_sub_ps(c[7], cc), f2));
+}
+
+// SSE2 version of HalfToFloat() for the 4 halves in the low 64 bits.
+inline __m128 HalfToFloat4(__m128i h) {
+  const __m128i shifted_exp = _mm_set1_epi32(0x7c00 << 13);
+  const __m128i x = _mm_unpacklo_epi16(h, _mm_setzero_si128());
+  const __m128i sign =
+      _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x8000)), 16);
+  __m128i o = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7fff)), 13);
+  const __m128i exp = _mm_and_si128(o, shifted_exp);
+  o = _mm_add_epi32(o, _mm_set1_epi32((127 - 15) << 23));
+
+  // Inf/NaN
+  const __m128i is_inf = _mm_cmpeq_epi32(exp, shifted_exp);
+  o = _mm_add_epi32(o, _mm_and_si128(is_inf, _mm_set1_epi32((128 - 16) << 23)));
+
+  // Quiet NaN(as HalfToFloat() does)
+  const __m128i is_nan = _mm_andnot_si128(
+      _mm_cmpeq_epi32(_mm_and_si128(o, _mm_set1_epi32(0x7fffff)),
+                      _mm_setzero_si128()),
+      is_inf);
+  o = _mm_or_si128(o, _mm_and_si128(is_nan, _mm_set1_epi32(0x400000)));
+
+  // Zero/subnormal
+  const __m128i is_den = _mm_cmpeq_epi32(exp, _mm_setzero_si128());
+  const __m128i den = _mm_castps_si128(
+      _mm_sub_ps(_mm_castsi128_ps(_mm_add_epi32(o, _mm_set1_epi32(1 << 23))),
+                 _mm_set1_ps(6.103515625e-05f)));
+  o = _mm_or_si128(_mm_and_si128(is_den, den), _mm_andnot_si128(is_den, o));
+
+  return _mm_castsi128_ps(_mm_or_si128(o, sign));
+}
+
+inline void StoreRGB(__m128 v, float out[3]) {
+  alignas(16) float tmp[4];
+  _mm_store_ps(tmp, v);
+  out[0] = tmp[0];
+  out[1] = tmp[1];
+  out[2] = tmp[2];
+}
+
+// Padded RGBA half LUT.
+void EvalTrilinearHalfSSE2(const half *d, const LUTCell &cell,
+                           float out[3]) {
+  __m128 c[8];
+  for (int k = 0; k < 8; k++) {
+    c[k] = HalfToFloat4(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(d + 4 * cell.idx[k])));
+  }
+  StoreRGB(Trilinear4(c, cell), out);
+}
+
+TINYCOLORIO_TARGET_F16C
+void EvalTrilinearHalfF16C(const half *d, const LUTCell &cell,
+                           float out[3]) {
+  __m128 c[8];
+  for (int k = 0; k < 8; k++) {
+    c[k] = _mm_cvtph_ps(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(d + 4 * cell.idx[k])));
+  }
+  StoreRGB(Trilinear4(c, cell), out);
+}
+
+void EvalTetrahedralHalfSSE2(const half *d, const LUTCell &cell,
+                             float out[3]) {
+  __m128 c[8];
+  for (int k = 0; k < 8; k++) {
+    c[k] = HalfToFloat4(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(d + 4 * cell.idx[k])));
+  }
+  StoreRGB(Tetrahedral4(c, cell), out);
+}
+
+TINYCOLORIO_TARGET_F16C
+void EvalTetrahedralHalfF16C(const half *d, const LUTCell &cell,
+                             float out[3]) {
+  __m128 c[8];
+  for (int k = 0; k < 8; k++) {
+    c[k] = _mm_cvtph_ps(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(d + 4 * cell.idx[k])));
+  }
+  StoreRGB(Tetrahedral4(c, cell), out);
+}
+
+// Blends cell corners given as z0/z1 halves of each component.
+inline void EvalCell4(const __m128 z0[3], const __m128 z1[3], const float f[3],
+                      float out[3]) {
+  const __m128 fz = _mm_set1_ps(f[2]);
+  __m128 r = Lerp4(z0[0], z1[0], fz);
+  __m128 g = Lerp4(z0[1], z1[1], fz);
+  __m128 b = Lerp4(z0[2], z1[2], fz);
+  __m128 a = _mm_setzero_ps();
+
+  // Components of the 4 (x, y) corners to one RGB_ vector per corner.
+  _MM_TRANSPOSE4_PS(r, g, b, a);
+
+  const __m128 fy = _mm_set1_ps(f[1]);
+  const __m128 x0 = Lerp4(r, b, fy);  // (x0, y0) - (x0, y1)
+  const __m128 x1 = Lerp4(g, a, fy);  // (x1, y0) - (x1, y1)
+  StoreRGB(Lerp4(x0, x1, _mm_set1_ps(f[0])), out);
+}
+
+void EvalCellHalfSSE2(const half *d, const float f[3], float out[3]) {
+  __m128 z0[3], z1[3];
+  for (int c = 0; c < 3; c++) {
+    const __m128i v =
+        _mm_load_si128(reinterpret_cast<const __m128i *>(d + 8 * c));
+    z0[c] = HalfToFloat4(v);
+    z1[c] = HalfToFloat4(_mm_srli_si128(v, 8));
+  }
+  EvalCell4(z0, z1, f, out);
+}
+
+TINYCOLORIO_TARGET_F16C
+void EvalCellHalfF16C(const half *d, const float f[3], float out[3]) {
+  __m128 z0[3], z1[3];
+  for (int c = 0; c < 3; c++) {
+    const __m128i v =
+        _mm_load_si128(reinterpret_cast<const __m128i *>(d + 8 * c));
+    z0[c] = _mm_cvtph_ps(v);
+    z1[c] = _mm_cvtph_ps(_mm_srli_si128(v, 8));
+  }
+  EvalCell4(z0, z1, f, out);
+}
+
+#endif
+
+// Interleaved pixels `src_stride`/`dst_stride` floats apart.
+struct InterleavedPixels {
+  const float *src;
+  float *dst;
+  size_t src_stride;
+  size_t dst_stride;
+
+  void load(size_t i, float rgb[3]) const {
+    const float *p = src + i * src_stride;
+    rgb[0] = p[0];
+    rgb[1] = p[1];
+    rgb[2] = p[2];
+  }
+
+  void store(size_t i, const float v[3]) const {
+    float *p = dst + i * dst_stride;
+    p[0] = v[0];
+    p[1] = v[1];
+    p[2] = v[2];
+  }
+};
+
+// R, G and B planes.
+struct PlanarPixels {
+  const float *const *src;
+  float *const *dst;
+
+  void load(size_t i, float rgb[3]) const {
+    rgb[0] = src[0][i];
+    rgb[1] = src[1][i];
+    rgb[2] = src[2][i];
+  }
+
+  void store(size_t i, const float v[3]) const {
+    dst[0][i] = v[0];
+    dst[1][i] = v[1];
+    dst[2][i] = v[2];
+  }
+};
+
+// Pixels are read before the result is written, so `src` and `dst` can
+// alias.
+template <typename Kernel, typename Pixels>
+inline void RunBatch(const Kernel &kernel, const Pixels &pixels,
+                     size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    float rgb[3], out[3];
+    pixels.load(i, rgb);
+    kernel(rgb, out);
+    pixels.store(i, out);
+  }
+}
+
+//
+// Per pixel kernels. EvalTrilinear() and ApplyBatch() select one for the
+// layout and CPU before the pixel loop(EvalBatch()).
+//
+
+template <typename T, LUT3DInterpolation I>
+struct ScalarKernel {
+  const LUT3DView<T> &lut;
+  float scale;
+  float offset;
+
+  void operator()(const float rgb[3], float out[3]) const {
+    LUTCell cell;
+    LUTCellAt(lut, rgb, &cell);
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      EvalTetrahedralScalar(lut, cell, scale, offset, out);
+    } else {
+      EvalTrilinearScalar(lut, cell, scale, offset, out);
+    }
+  }
+};
+
+template <typename T>
+struct CellsScalarKernel {
+  const LUT3DCells<T> &cells;
+
+  void operator()(const float rgb[3], float out[3]) const {
+    float f[3];
+    EvalCellScalar(CellAt(cells, rgb, f), f, out);
+  }
+};
+
+#if defined(TINYCOLORIO_USE_SSE2)
+
+// kPaddedRGBA and kBrickedRGBA, one vector load per corner.
+template <LUT3DInterpolation I>
+struct RGBAKernelf {
+  const LUT3DViewf &lut;
+
+  void operator()(const float rgb[3], float out[3]) const {
+    LUTCell cell;
+    LUTCellAt(lut, rgb, &cell);
+
+    // Unaligned loads: views may wrap caller buffers. As fast as aligned
+    // loads on aligned data.
+    const float *d = lut.data_;
+    __m128 c[8];
+    for (int k = 0; k < 8; k++) {
+      c[k] = _mm_loadu_ps(d + 4 * cell.idx[k]);
+    }
+    StoreRGB((I == LUT3DInterpolation::kTetrahedral) ? Tetrahedral4(c, cell)
+                                                      : Trilinear4(c, cell),
+             out);
+  }
+};
+
+template <LUT3DInterpolation I>
+struct RGBAKernelu16 {
+  const LUT3DViewu16 &lut;
+
+  __m128 load(size_t idx) const {
+    const __m128i v = _mm_loadl_epi64(
+        reinterpret_cast<const __m128i *>(lut.data_ + 4 * idx));
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+  }
+
+  void operator()(const float rgb[3], float out[3]) const {
+    LUTCell cell;
+    LUTCellAt(lut, rgb, &cell);
+
+    __m128 c[8];
+    for (int k = 0; k < 8; k++) {
+      c[k] = load(cell.idx[k]);
+    }
+    const __m128 v = (I == LUT3DInterpolation::kTetrahedral)
+                         ? Tetrahedral4(c, cell)
+                         : Trilinear4(c, cell);
+
+    // Interpolation is linear, so dequantize once after blending.
+    StoreRGB(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(lut.scale_)),
+                        _mm_set1_ps(lut.offset_)),
+             out);
+  }
+};
+
+struct RGBAKernelh {
+  const LUT3DViewh &lut;
+  void (*eval)(const half *, const LUTCell &, float *);  // F16C or SSE2
+
+  void operator()(const float rgb[3], float out[3]) const {
+    LUTCell cell;
+    LUTCellAt(lut, rgb, &cell);
+    eval(lut.data_, cell, out);
+  }
+};
+
+struct CellsKernelf {
+  const LUT3DCellsf &cells;
+
+  void operator()(const float rgb[3], float out[3]) const {
+    float f[3];
+    const float *d = CellAt(cells, rgb, f);
+    __m128 z0[3], z1[3];
+    for (int c = 0; c < 3; c++) {
+      z0[c] = _mm_load_ps(d + 8 * c);
+      z1[c] = _mm_load_ps(d + 8 * c + 4);
+    }
+    EvalCell4(z0, z1, f, out);
+  }
+};
+
+struct CellsKernelh {
+  const LUT3DCellsh &cells;
+  void (*eval)(const half *, const float *, float *);  // F16C or SSE2
+
+  void operator()(const float rgb[3], float out[3]) const {
+    float f[3];
+    eval(CellAt(cells, rgb, f), f, out);
+  }
+};
+
+#endif
+
+template <LUT3DInterpolation I, typename Pixels>
+void EvalBatch(const LUT3DViewf &lut, const Pixels &pixels, size_t count) {
+  if (IsEmptyLUT(lut)) {
+    return;
+  }
+#if defined(TINYCOLORIO_USE_SSE2)
+  if (IsRGBALayout(lut.layout())) {
+    RunBatch(RGBAKernelf<I>{lut}, pixels, count);
+    return;
+  }
+#endif
+  RunBatch(ScalarKernel<float, I>{lut, 1.0f, 0.0f}, pixels, count);
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+void EvalBatch(const LUT3DViewh &lut, const Pixels &pixels, size_t count) {
+  if (IsEmptyLUT(lut)) {
+    return;
+  }
+#if defined(TINYCOLORIO_USE_SSE2)
+  if (IsRGBALayout(lut.layout())) {
+    const bool f16c = GetCPUFeatures().f16c;
+    RGBAKernelh kernel{lut, f16c ? EvalTrilinearHalfF16C
+                                 : EvalTrilinearHalfSSE2};
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      kernel.eval = f16c ? EvalTetrahedralHalfF16C : EvalTetrahedralHalfSSE2;
+    }
+    RunBatch(kernel, pixels, count);
+    return;
+  }
+#endif
+  RunBatch(ScalarKernel<half, I>{lut, 1.0f, 0.0f}, pixels, count);
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+void EvalBatch(const LUT3DViewu16 &lut, const Pixels &pixels, size_t count) {
+  if (IsEmptyLUT(lut)) {
+    return;
+  }
+#if defined(TINYCOLORIO_USE_SSE2)
+  if (IsRGBALayout(lut.layout())) {
+    RunBatch(RGBAKernelu16<I>{lut}, pixels, count);
+    return;
+  }
+#endif
+  RunBatch(ScalarKernel<uint16_t, I>{lut, lut.scale_, lut.offset_}, pixels,
+           count);
+}
+
+template <typename Pixels>
+void EvalBatch(const LUT3DCellsf &cells, const Pixels &pixels, size_t count) {
+  if (cells.data_.empty()) {
+    return;
+  }
+#if defined(TINYCOLORIO_USE_SSE2)
+  RunBatch(CellsKernelf{cells}, pixels, count);
+#else
+  RunBatch(CellsScalarKernel<float>{cells}, pixels, count);
+#endif
+}
+
+template <typename Pixels>
+void EvalBatch(const LUT3DCellsh &cells, const Pixels &pixels, size_t count) {
+  if (cells.data_.empty()) {
+    return;
+  }
+#if defined(TINYCOLORIO_USE_SSE2)
+  const CellsKernelh kernel{
+      cells, GetCPUFeatures().f16c ? EvalCellHalfF16C : EvalCellHalfSSE2};
+  RunBatch(kernel, pixels, count);
+#else
+  RunBatch(CellsScalarKernel<half>{cells}, pixels, count);
+#endif
+}
+
+//
+// Vector kernels of ApplyBatch() for float LUTs: 16(AVX-512F), 8(AVX2 + FMA)
+// or 4(SSE4.1) pixels at a time, one component of all pixels per register.
+//
+
+// SetMaxSIMDLevel() limit.
+inline std::atomic<uint32_t> &MaxSIMDLevel() {
+  static std::atomic<uint32_t> level{uint32_t(SIMDLevel::kAVX512)};
+  return level;
+}
+
+// The best tier supported by the CPU, up to MaxSIMDLevel().
+inline SIMDLevel BatchSIMDLevel() {
+#if defined(TINYCOLORIO_USE_SSE2)
+  const uint32_t max_level = MaxSIMDLevel().load(std::memory_order_relaxed);
+  const CPUFeatures &cpu = GetCPUFeatures();
+  if ((max_level >= uint32_t(SIMDLevel::kAVX512)) && cpu.avx512f) {
+    return SIMDLevel::kAVX512;
+  }
+  if ((max_level >= uint32_t(SIMDLevel::kAVX2)) && cpu.avx2 && cpu.fma) {
+    return SIMDLevel::kAVX2;
+  }
+  if ((max_level >= uint32_t(SIMDLevel::kSSE41)) && cpu.sse41) {
+    return SIMDLevel::kSSE41;
+  }
+#endif
+  return SIMDLevel::kScalar;
+}
+
+// Float LUT in a layout with constant strides(all but kBrickedRGBA).
+// Offsets are in floats.
+struct VectorLUT {
+  const float *data;
+  int dim[3];
+  int stride[3];         // x, y and z
+  int component_stride;  // 1 unless kPlanar
+  bool rgba;             // corners are loaded as RGBA vectors
+};
+
+// Returns false when the LUT needs the per pixel kernels: kBrickedRGBA,
+// single sample axes or offsets beyond int32.
+inline bool MakeVectorLUT(const LUT3DViewf &lut, VectorLUT *v) {
+  const size_t max_offset = size_t(std::numeric_limits<int32_t>::max());
+  if ((lut.data_ == nullptr) ||
+      (lut.layout() == LUT3DLayout::kBrickedRGBA) || (lut.x_dim_ < 2) ||
+      (lut.y_dim_ < 2) || (lut.z_dim_ < 2) ||
+      (lut.x_dim_ > max_offset) || (lut.y_dim_ > max_offset) ||
+      (lut.z_dim_ > max_offset) || (lut.num_values() >= max_offset)) {
+    return false;
+  }
+
+  const size_t origin = lut.offset(lut.index(0, 0, 0), 0);
+  v->data = lut.data_;
+  v->dim[0] = int(lut.x_dim_);
+  v->dim[1] = int(lut.y_dim_);
+  v->dim[2] = int(lut.z_dim_);
+  v->stride[0] = int(lut.offset(lut.index(1, 0, 0), 0) - origin);
+  v->stride[1] = int(lut.offset(lut.index(0, 1, 0), 0) - origin);
+  v->stride[2] = int(lut.offset(lut.index(0, 0, 1), 0) - origin);
+  v->component_stride = int(lut.offset(lut.index(0, 0, 0), 1) - origin);
+  v->rgba = IsRGBALayout(lut.layout());
+  return true;
+}
+
+#if defined(TINYCOLORIO_USE_SSE2)
+
+// Vector LUTCoord().
+TINYCOLORIO_TARGET_AVX2_FMA
+inline void LUTCoord8(__m256 v, int dim, __m256i *i, __m256 *f) {
+  // max() returns its second operand for NaN.
+  v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                    _mm256_set1_ps(1.0f));
+  const __m256 p = _mm256_mul_ps(v, _mm256_set1_ps(float(dim - 1)));
+  (*i) = _mm256_min_epi32(_mm256_cvttps_epi32(p), _mm256_set1_epi32(dim - 2));
+  (*f) = _mm256_sub_ps(p, _mm256_cvtepi32_ps(*i));
+}
+
+TINYCOLORIO_TARGET_AVX2_FMA
+inline __m256 Lerp8(__m256 a, __m256 b, __m256 t) {
+  return _mm256_fmadd_ps(_mm256_sub_ps(b, a), t, a);
+}
+
+// RGB of the entries at `offset` of 8 pixels.
+TINYCOLORIO_TARGET_AVX2_FMA
+inline void LoadCorner8(const VectorLUT &lut, __m256i offset, __m256 rgb[3]) {
+  if (lut.rgba) {
+    // RGBA loads transposed to components, cheaper than 3 gathers.
+    alignas(32) int32_t o[8];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(o), offset);
+    const float *d = lut.data;
+    const __m256 t0 = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(d + o[0])), _mm_loadu_ps(d + o[4]),
+        1);
+    const __m256 t1 = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(d + o[1])), _mm_loadu_ps(d + o[5]),
+        1);
+    const __m256 t2 = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(d + o[2])), _mm_loadu_ps(d + o[6]),
+        1);
+    const __m256 t3 = _mm256_insertf128_ps(
+        _mm256_castps128_ps256(_mm_loadu_ps(d + o[3])), _mm_loadu_ps(d + o[7]),
+        1);
+    const __m256 rg01 = _mm256_unpacklo_ps(t0, t1);
+    const __m256 ba01 = _mm256_unpackhi_ps(t0, t1);
+    const __m256 rg23 = _mm256_unpacklo_ps(t2, t3);
+    const __m256 ba23 = _mm256_unpackhi_ps(t2, t3);
+    rgb[0] = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0));
+    rgb[1] = _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2));
+    rgb[2] = _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0));
+    return;
+  }
+
+  for (int c = 0; c < 3; c++) {
+    rgb[c] = _mm256_i32gather_ps(lut.data + c * lut.component_stride, offset,
+                                 4);
+  }
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+TINYCOLORIO_TARGET_AVX2_FMA void ApplyBatchAVX2(const VectorLUT &lut,
+                                                const Pixels &pixels,
+                                                size_t count) {
+  const __m256i sx = _mm256_set1_epi32(lut.stride[0]);
+  const __m256i sy = _mm256_set1_epi32(lut.stride[1]);
+  const __m256i sz = _mm256_set1_epi32(lut.stride[2]);
+
+  for (size_t i = 0; i < count; i += 8) {
+    // The last pixels are padded to 8, so that a pixel's result does not
+    // depend on its position.
+    const size_t n = std::min(count - i, size_t(8));
+    alignas(32) float in[3][8] = {};
+    for (size_t k = 0; k < n; k++) {
+      float rgb[3];
+      pixels.load(i + k, rgb);
+      in[0][k] = rgb[0];
+      in[1][k] = rgb[1];
+      in[2][k] = rgb[2];
+    }
+
+    __m256i ix, iy, iz;
+    __m256 fx, fy, fz;
+    LUTCoord8(_mm256_load_ps(in[0]), lut.dim[0], &ix, &fx);
+    LUTCoord8(_mm256_load_ps(in[1]), lut.dim[1], &iy, &fy);
+    LUTCoord8(_mm256_load_ps(in[2]), lut.dim[2], &iz, &fz);
+    const __m256i o0 = _mm256_add_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(ix, sx),
+                         _mm256_mullo_epi32(iy, sy)),
+        _mm256_mullo_epi32(iz, sz));
+    const __m256i o7 =
+        _mm256_add_epi32(o0, _mm256_add_epi32(_mm256_add_epi32(sx, sy), sz));
+
+    __m256 out[3];
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      // Same tetrahedron as LUTTetrahedron(), 4 corners per pixel.
+      const __m256 xy = _mm256_cmp_ps(fx, fy, _CMP_GT_OQ);
+      const __m256 yz = _mm256_cmp_ps(fy, fz, _CMP_GT_OQ);
+      const __m256 zx = _mm256_cmp_ps(fz, fx, _CMP_GE_OQ);
+      const __m256i bx = _mm256_castps_si256(_mm256_andnot_ps(zx, xy));
+      const __m256i by = _mm256_castps_si256(_mm256_andnot_ps(xy, yz));
+      const __m256i bz = _mm256_castps_si256(_mm256_andnot_ps(yz, zx));
+
+      // b: first axis, c: all axes but the last one.
+      const __m256i ob = _mm256_or_si256(
+          _mm256_or_si256(_mm256_and_si256(bx, sx), _mm256_and_si256(by, sy)),
+          _mm256_and_si256(bz, sz));
+      const __m256i lx = _mm256_castps_si256(_mm256_andnot_ps(xy, zx));
+      const __m256i ly = _mm256_castps_si256(_mm256_andnot_ps(yz, xy));
+      const __m256i lz = _mm256_castps_si256(_mm256_andnot_ps(zx, yz));
+      const __m256i oc = _mm256_or_si256(
+          _mm256_or_si256(_mm256_and_si256(lx, _mm256_add_epi32(sy, sz)),
+                          _mm256_and_si256(ly, _mm256_add_epi32(sx, sz))),
+          _mm256_and_si256(lz, _mm256_add_epi32(sx, sy)));
+
+      const __m256 lo = _mm256_min_ps(fx, fy);
+      const __m256 hi = _mm256_max_ps(fx, fy);
+      const __m256 f0 = _mm256_max_ps(hi, fz);
+      const __m256 f1 = _mm256_max_ps(lo, _mm256_min_ps(hi, fz));
+      const __m256 f2 = _mm256_min_ps(lo, fz);
+
+      __m256 c0[3], cb[3], cc[3], c7[3];
+      LoadCorner8(lut, o0, c0);
+      LoadCorner8(lut, _mm256_add_epi32(o0, ob), cb);
+      LoadCorner8(lut, _mm256_add_epi32(o0, oc), cc);
+      LoadCorner8(lut, o7, c7);
+      for (int c = 0; c < 3; c++) {
+        __m256 v = _mm256_fmadd_ps(_mm256_sub_ps(cb[c], c0[c]), f0, c0[c]);
+        v = _mm256_fmadd_ps(_mm256_sub_ps(cc[c], cb[c]), f1, v);
+        out[c] = _mm256_fmadd_ps(_mm256_sub_ps(c7[c], cc[c]), f2, v);
+      }
+    } else {
+      // x, then y, then z as Trilinear4().
+      const __m256i o2 = _mm256_add_epi32(o0, sy);
+      const __m256i o4 = _mm256_add_epi32(o0, sz);
+      const __m256i o6 = _mm256_add_epi32(o4, sy);
+      __m256 a[3], b[3], v00[3], v10[3], v01[3], v11[3];
+      LoadCorner8(lut, o0, a);
+      LoadCorner8(lut, _mm256_add_epi32(o0, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v00[c] = Lerp8(a[c], b[c], fx);
+      }
+      LoadCorner8(lut, o2, a);
+      LoadCorner8(lut, _mm256_add_epi32(o2, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v10[c] = Lerp8(a[c], b[c], fx);
+      }
+      LoadCorner8(lut, o4, a);
+      LoadCorner8(lut, _mm256_add_epi32(o4, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v01[c] = Lerp8(a[c], b[c], fx);
+      }
+      LoadCorner8(lut, o6, a);
+      LoadCorner8(lut, o7, b);
+      for (int c = 0; c < 3; c++) {
+        v11[c] = Lerp8(a[c], b[c], fx);
+        out[c] = Lerp8(Lerp8(v00[c], v10[c], fy), Lerp8(v01[c], v11[c], fy),
+                       fz);
+      }
+    }
+
+    alignas(32) float result[3][8];
+    for (int c = 0; c < 3; c++) {
+      _mm256_store_ps(result[c], out[c]);
+    }
+    for (size_t k = 0; k < n; k++) {
+      const float rgb[3] = {result[0][k], result[1][k], result[2][k]};
+      pixels.store(i + k, rgb);
+    }
+  }
+}
+
+// SSE4.1 counterparts. Lerps are mul + add in the order of the per pixel
+// kernels, so results are identical to EvalTrilinear()/EvalTetrahedral().
+
+TINYCOLORIO_TARGET_SSE41
+inline void LUTCoord4(__m128 v, int dim, __m128i *i, __m128 *f) {
+  v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+  const __m128 p = _mm_mul_ps(v, _mm_set1_ps(float(dim - 1)));
+  (*i) = _mm_min_epi32(_mm_cvttps_epi32(p), _mm_set1_epi32(dim - 2));
+  (*f) = _mm_sub_ps(p, _mm_cvtepi32_ps(*i));
+}
+
+TINYCOLORIO_TARGET_SSE41
+inline void LoadCorner4(const VectorLUT &lut, __m128i offset, __m128 rgb[3]) {
+  alignas(16) int32_t o[4];
+  _mm_store_si128(reinterpret_cast<__m128i *>(o), offset);
+  const float *d = lut.data;
+  if (lut.rgba) {
+    __m128 r = _mm_loadu_ps(d + o[0]);
+    __m128 g = _mm_loadu_ps(d + o[1]);
+    __m128 b = _mm_loadu_ps(d + o[2]);
+    __m128 a = _mm_loadu_ps(d + o[3]);
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    rgb[0] = r;
+    rgb[1] = g;
+    rgb[2] = b;
+    return;
+  }
+
+  for (int c = 0; c < 3; c++) {
+    const float *dc = d + c * lut.component_stride;
+    rgb[c] = _mm_setr_ps(dc[o[0]], dc[o[1]], dc[o[2]], dc[o[3]]);
+  }
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+TINYCOLORIO_TARGET_SSE41 void ApplyBatchSSE41(const VectorLUT &lut,
+                                              const Pixels &pixels,
+                                              size_t count) {
+  const __m128i sx = _mm_set1_epi32(lut.stride[0]);
+  const __m128i sy = _mm_set1_epi32(lut.stride[1]);
+  const __m128i sz = _mm_set1_epi32(lut.stride[2]);
+
+  for (size_t i = 0; i < count; i += 4) {
+    const size_t n = std::min(count - i, size_t(4));
+    alignas(16) float in[3][4] = {};
+    for (size_t k = 0; k < n; k++) {
+      float rgb[3];
+      pixels.load(i + k, rgb);
+      in[0][k] = rgb[0];
+      in[1][k] = rgb[1];
+      in[2][k] = rgb[2];
+    }
+
+    __m128i ix, iy, iz;
+    __m128 fx, fy, fz;
+    LUTCoord4(_mm_load_ps(in[0]), lut.dim[0], &ix, &fx);
+    LUTCoord4(_mm_load_ps(in[1]), lut.dim[1], &iy, &fy);
+    LUTCoord4(_mm_load_ps(in[2]), lut.dim[2], &iz, &fz);
+    const __m128i o0 = _mm_add_epi32(
+        _mm_add_epi32(_mm_mullo_epi32(ix, sx), _mm_mullo_epi32(iy, sy)),
+        _mm_mullo_epi32(iz, sz));
+    const __m128i o7 =
+        _mm_add_epi32(o0, _mm_add_epi32(_mm_add_epi32(sx, sy), sz));
+
+    __m128 out[3];
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      const __m128 xy = _mm_cmpgt_ps(fx, fy);
+      const __m128 yz = _mm_cmpgt_ps(fy, fz);
+      const __m128 zx = _mm_cmpge_ps(fz, fx);
+      const __m128i bx = _mm_castps_si128(_mm_andnot_ps(zx, xy));
+      const __m128i by = _mm_castps_si128(_mm_andnot_ps(xy, yz));
+      const __m128i bz = _mm_castps_si128(_mm_andnot_ps(yz, zx));
+      const __m128i ob = _mm_or_si128(
+          _mm_or_si128(_mm_and_si128(bx, sx), _mm_and_si128(by, sy)),
+          _mm_and_si128(bz, sz));
+      const __m128i lx = _mm_castps_si128(_mm_andnot_ps(xy, zx));
+      const __m128i ly = _mm_castps_si128(_mm_andnot_ps(yz, xy));
+      const __m128i lz = _mm_castps_si128(_mm_andnot_ps(zx, yz));
+      const __m128i oc = _mm_or_si128(
+          _mm_or_si128(_mm_and_si128(lx, _mm_add_epi32(sy, sz)),
+                       _mm_and_si128(ly, _mm_add_epi32(sx, sz))),
+          _mm_and_si128(lz, _mm_add_epi32(sx, sy)));
+
+      const __m128 lo = _mm_min_ps(fx, fy);
+      const __m128 hi = _mm_max_ps(fx, fy);
+      const __m128 f0 = _mm_max_ps(hi, fz);
+      const __m128 f1 = _mm_max_ps(lo, _mm_min_ps(hi, fz));
+      const __m128 f2 = _mm_min_ps(lo, fz);
+
+      __m128 c0[3], cb[3], cc[3], c7[3];
+      LoadCorner4(lut, o0, c0);
+      LoadCorner4(lut, _mm_add_epi32(o0, ob), cb);
+      LoadCorner4(lut, _mm_add_epi32(o0, oc), cc);
+      LoadCorner4(lut, o7, c7);
+      for (int c = 0; c < 3; c++) {
+        __m128 v = _mm_add_ps(c0[c], _mm_mul_ps(_mm_sub_ps(cb[c], c0[c]), f0));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_sub_ps(cc[c], cb[c]), f1));
+        out[c] = _mm_add_ps(v, _mm_mul_ps(_mm_sub_ps(c7[c], cc[c]), f2));
+      }
+    } else {
+      const __m128i o2 = _mm_add_epi32(o0, sy);
+      const __m128i o4 = _mm_add_epi32(o0, sz);
+      const __m128i o6 = _mm_add_epi32(o4, sy);
+      __m128 a[3], b[3], v00[3], v10[3], v01[3], v11[3];
+      LoadCorner4(lut, o0, a);
+      LoadCorner4(lut, _mm_add_epi32(o0, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v00[c] = Lerp4(a[c], b[c], fx);
+      }
+      LoadCorner4(lut, o2, a);
+      LoadCorner4(lut, _mm_add_epi32(o2, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v10[c] = Lerp4(a[c], b[c], fx);
+      }
+      LoadCorner4(lut, o4, a);
+      LoadCorner4(lut, _mm_add_epi32(o4, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v01[c] = Lerp4(a[c], b[c], fx);
+      }
+      LoadCorner4(lut, o6, a);
+      LoadCorner4(lut, o7, b);
+      for (int c = 0; c < 3; c++) {
+        v11[c] = Lerp4(a[c], b[c], fx);
+        out[c] = Lerp4(Lerp4(v00[c], v10[c], fy), Lerp4(v01[c], v11[c], fy),
+                       fz);
+      }
+    }
+
+    alignas(16) float result[3][4];
+    for (int c = 0; c < 3; c++) {
+      _mm_store_ps(result[c], out[c]);
+    }
+    for (size_t k = 0; k < n; k++) {
+      const float rgb[3] = {result[0][k], result[1][k], result[2][k]};
+      pixels.store(i + k, rgb);
+    }
+  }
+}
+
+// AVX-512F counterparts. Same operations as the AVX2 kernel, so results are
+// identical to it. The tetrahedron is selected with mask registers.
+
+// GCC 12.1/12.2 warn about _mm512_undefined_*() inside the AVX-512 intrinsics
+// (GCC bug 105593).
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+TINYCOLORIO_TARGET_AVX512F
+inline void LUTCoord16(__m512 v, int dim, __m512i *i, __m512 *f) {
+  v = _mm512_min_ps(_mm512_max_ps(v, _mm512_setzero_ps()),
+                    _mm512_set1_ps(1.0f));
+  const __m512 p = _mm512_mul_ps(v, _mm512_set1_ps(float(dim - 1)));
+  (*i) = _mm512_min_epi32(_mm512_cvttps_epi32(p), _mm512_set1_epi32(dim - 2));
+  (*f) = _mm512_sub_ps(p, _mm512_cvtepi32_ps(*i));
+}
+
+TINYCOLORIO_TARGET_AVX512F
+inline __m512 Lerp16(__m512 a, __m512 b, __m512 t) {
+  return _mm512_fmadd_ps(_mm512_sub_ps(b, a), t, a);
+}
+
+// Gathers for all layouts: with 16 lanes they beat the RGBA transpose of
+// LoadCorner8().
+TINYCOLORIO_TARGET_AVX512F
+inline void LoadCorner16(const VectorLUT &lut, __m512i offset,
+                         __m512 rgb[3]) {
+  for (int c = 0; c < 3; c++) {
+    rgb[c] = _mm512_i32gather_ps(offset, lut.data + c * lut.component_stride,
+                                 4);
+  }
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+TINYCOLORIO_TARGET_AVX512F void ApplyBatchAVX512(const VectorLUT &lut,
+                                                 const Pixels &pixels,
+                                                 size_t count) {
+  const __m512i sx = _mm512_set1_epi32(lut.stride[0]);
+  const __m512i sy = _mm512_set1_epi32(lut.stride[1]);
+  const __m512i sz = _mm512_set1_epi32(lut.stride[2]);
+
+  for (size_t i = 0; i < count; i += 16) {
+    const size_t n = std::min(count - i, size_t(16));
+    alignas(64) float in[3][16] = {};
+    for (size_t k = 0; k < n; k++) {
+      float rgb[3];
+      pixels.load(i + k, rgb);
+      in[0][k] = rgb[0];
+      in[1][k] = rgb[1];
+      in[2][k] = rgb[2];
+    }
+
+    __m512i ix, iy, iz;
+    __m512 fx, fy, fz;
+    LUTCoord16(_mm512_load_ps(in[0]), lut.dim[0], &ix, &fx);
+    LUTCoord16(_mm512_load_ps(in[1]), lut.dim[1], &iy, &fy);
+    LUTCoord16(_mm512_load_ps(in[2]), lut.dim[2], &iz, &fz);
+    const __m512i o0 = _mm512_add_epi32(
+        _mm512_add_epi32(_mm512_mullo_epi32(ix, sx),
+                         _mm512_mullo_epi32(iy, sy)),
+        _mm512_mullo_epi32(iz, sz));
+    const __m512i o7 =
+        _mm512_add_epi32(o0, _mm512_add_epi32(_mm512_add_epi32(sx, sy), sz));
+
+    __m512 out[3];
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      const __mmask16 xy = _mm512_cmp_ps_mask(fx, fy, _CMP_GT_OQ);
+      const __mmask16 yz = _mm512_cmp_ps_mask(fy, fz, _CMP_GT_OQ);
+      const __mmask16 zx = _mm512_cmp_ps_mask(fz, fx, _CMP_GE_OQ);
+
+      // Exactly one of the masks of b(first axis) and of c(last axis) is set
+      // per lane: b = o0 + first axis, c = o7 - last axis.
+      __m512i ob = _mm512_mask_add_epi32(o0, _mm512_kandn(zx, xy), o0, sx);
+      ob = _mm512_mask_add_epi32(ob, _mm512_kandn(xy, yz), o0, sy);
+      ob = _mm512_mask_add_epi32(ob, _mm512_kandn(yz, zx), o0, sz);
+      __m512i oc = _mm512_mask_sub_epi32(o7, _mm512_kandn(xy, zx), o7, sx);
+      oc = _mm512_mask_sub_epi32(oc, _mm512_kandn(yz, xy), o7, sy);
+      oc = _mm512_mask_sub_epi32(oc, _mm512_kandn(zx, yz), o7, sz);
+
+      const __m512 lo = _mm512_min_ps(fx, fy);
+      const __m512 hi = _mm512_max_ps(fx, fy);
+      const __m512 f0 = _mm512_max_ps(hi, fz);
+      const __m512 f1 = _mm512_max_ps(lo, _mm512_min_ps(hi, fz));
+      const __m512 f2 = _mm512_min_ps(lo, fz);
+
+      __m512 c0[3], cb[3], cc[3], c7[3];
+      LoadCorner16(lut, o0, c0);
+      LoadCorner16(lut, ob, cb);
+      LoadCorner16(lut, oc, cc);
+      LoadCorner16(lut, o7, c7);
+      for (int c = 0; c < 3; c++) {
+        __m512 v = _mm512_fmadd_ps(_mm512_sub_ps(cb[c], c0[c]), f0, c0[c]);
+        v = _mm512_fmadd_ps(_mm512_sub_ps(cc[c], cb[c]), f1, v);
+        out[c] = _mm512_fmadd_ps(_mm512_sub_ps(c7[c], cc[c]), f2, v);
+      }
+    } else {
+      const __m512i o2 = _mm512_add_epi32(o0, sy);
+      const __m512i o4 = _mm512_add_epi32(o0, sz);
+      const __m512i o6 = _mm512_add_epi32(o4, sy);
+      __m512 a[3], b[3], v00[3], v10[3], v01[3], v11[3];
+      LoadCorner16(lut, o0, a);
+      LoadCorner16(lut, _mm512_add_epi32(o0, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v00[c] = Lerp16(a[c], b[c], fx);
+      }
+      LoadCorner16(lut, o2, a);
+      LoadCorner16(lut, _mm512_add_epi32(o2, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v10[c] = Lerp16(a[c], b[c], fx);
+      }
+      LoadCorner16(lut, o4, a);
+      LoadCorner16(lut, _mm512_add_epi32(o4, sx), b);
+      for (int c = 0; c < 3; c++) {
+        v01[c] = Lerp16(a[c], b[c], fx);
+      }
+      LoadCorner16(lut, o6, a);
+      LoadCorner16(lut, o7, b);
+      for (int c = 0; c < 3; c++) {
+        v11[c] = Lerp16(a[c], b[c], fx);
+        out[c] = Lerp16(Lerp16(v00[c], v10[c], fy),
+                        Lerp16(v01[c], v11[c], fy), fz);
+      }
+    }
+
+    alignas(64) float result[3][16];
+    for (int c = 0; c < 3; c++) {
+      _mm512_store_ps(result[c], out[c]);
+    }
+    for (size_t k = 0; k < n; k++) {
+      const float rgb[3] = {result[0][k], result[1][k], result[2][k]};
+      pixels.store(i + k, rgb);
+    }
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif
+
+// ApplyBatch() of a float LUT: vector kernels when the CPU and the LUT
+// allow, the per pixel kernels of EvalTrilinear()/EvalTetrahedral()
+// otherwise.
+template <LUT3DInterpolation I, typename Pixels>
+void ApplyBatchImpl(const LUT3DViewf &lut, const Pixels &pixels,
+                    size_t count) {
+#if defined(TINYCOLORIO_USE_SSE2)
+  VectorLUT vlut;
+  const SIMDLevel level = BatchSIMDLevel();
+  if ((level != SIMDLevel::kScalar) && MakeVectorLUT(lut, &vlut)) {
+    if (level == SIMDLevel::kAVX512) {
+      ApplyBatchAVX512<I>(vlut, pixels, count);
+    } else if (level == SIMDLevel::kAVX2) {
+      ApplyBatchAVX2<I>(vlut, pixels, count);
+    } else {
+      ApplyBatchSSE41<I>(vlut, pixels, count);
+    }
+    return;
+  }
+#endif
+  EvalBatch<I>(lut, pixels, count);
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+void ApplyBatchImpl(const LUT3DViewu16 &lut, const Pixels &pixels,
+                    size_t count) {
+  EvalBatch<I>(lut, pixels, count);
+}
+
+template <LUT3DInterpolation I, typename Pixels>
+void ApplyBatchImpl(const LUT3DViewh &lut, const Pixels &pixels,
+                    size_t count) {
+  EvalBatch<I>(lut, pixels, count);
+}
+
+}  // namespace
+
+bool ConvertLUT3D(const LUT3Df &src, LUT3Du16 *dst, LUT3DLayout layout,
+                  std::string *err) {
+  if (!dst) {
+    return false;
+  }
+
+  // Padding entries of `src` are excluded from the value range.
+  float lo = std::numeric_limits<float>::max();
+  float hi = -std::numeric_limits<float>::max();
+  for (size_t z = 0; z < src.z_dim_; z++) {
+    for (size_t y = 0; y < src.y_dim_; y++) {
+      for (size_t x = 0; x < src.x_dim_; x++) {
+        const size_t i = src.index(x, y, z);
+        for (size_t c = 0; c < 3; c++) {
+          const float v = src.data_[src.offset(i, c)];
+          if (!std::isfinite(v)) {
+            if (err) {
+              (*err) = "Non-finite value in 3D LUT at " + std::to_string(x) +
+                       " " + std::to_string(y) + " " + std::to_string(z);
+            }
+            return false;
+          }
+          lo = std::min(lo, v);
+          hi = std::max(hi, v);
+        }
+      }
+    }
+  }
+  if (!(lo < hi)) {
+    // Empty or constant LUT.
+    lo = (lo <= hi) ? lo : 0.0f;
+    hi = lo + 1.0f;
+  }
+  if (!CheckQuantizeRange(lo, hi, err)) {
+    return false;
+  }
+
+  LoadOptions options;
+  options.quantize_range[0] = lo;
+  options.quantize_range[1] = hi;
+
+  // Padding values stay zero.
+  dst->create(src.x_dim_, src.y_dim_, src.z_dim_, layout);
+  SetQuantization(options, dst);
+
+  ValueEncoder<uint16_t> encode;
+  encode.init(dst->offset_, dst->scale_);
+  for (size_t z = 0; z < src.z_dim_; z++) {
+    for (size_t y = 0; y < src.y_dim_; y++) {
+      for (size_t x = 0; x < src.x_dim_; x++) {
+        const size_t i = src.index(x, y, z);
+        const size_t d = dst->index(x, y, z);
+        for (size_t c = 0; c < 3; c++) {
+          dst->data_[dst->offset(d, c)] = encode(src.data_[src.offset(i, c)]);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void EvalTrilinear(const LUT3DViewf &lut, const float rgb[3], float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTrilinear>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTrilinear(const LUT3DViewh &lut, const float rgb[3], float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTrilinear>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTrilinear(const LUT3DViewu16 &lut, const float rgb[3],
+                   float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTrilinear>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTetrahedral(const LUT3DViewf &lut, const float rgb[3],
+                     float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTetrahedral>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTetrahedral(const LUT3DViewh &lut, const float rgb[3],
+                     float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTetrahedral>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTetrahedral(const LUT3DViewu16 &lut, const float rgb[3],
+                     float out[3]) {
+  EvalBatch<LUT3DInterpolation::kTetrahedral>(
+      lut, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+namespace {
+
+// Padded RGBA kernel for a X x Y x Z LUT. x1 - x0 etc. are known, so the 8
+// corners are constant offsets from the first one.
+template <size_t X, size_t Y, size_t Z>
+void EvalTrilinearFixed(const LUT3DViewf &lut, const float *rgb, float *out) {
+  static_assert((X > 1) && (Y > 1) && (Z > 1), "Invalid LUT dimensions");
+  constexpr size_t SX = 4;
+  constexpr size_t SY = SX * X;
+  constexpr size_t SZ = SY * Y;
+
+  LUTCell cell;
+  size_t x0, y0, z0, unused;
+  LUTCoord(rgb[0], X, &x0, &unused, &cell.fx);
+  LUTCoord(rgb[1], Y, &y0, &unused, &cell.fy);
+  LUTCoord(rgb[2], Z, &z0, &unused, &cell.fz);
+  const float *d = lut.data_ + (SZ * z0 + SY * y0 + SX * x0);
+
+#if defined(TINYCOLORIO_USE_SSE2)
+  __m128 c[8];
+  c[0] = _mm_loadu_ps(d);
+  c[1] = _mm_loadu_ps(d + SX);
+  c[2] = _mm_loadu_ps(d + SY);
+  c[3] = _mm_loadu_ps(d + SY + SX);
+  c[4] = _mm_loadu_ps(d + SZ);
+  c[5] = _mm_loadu_ps(d + SZ + SX);
+  c[6] = _mm_loadu_ps(d + SZ + SY);
+  c[7] = _mm_loadu_ps(d + SZ + SY + SX);
+  StoreRGB(Trilinear4(c, cell), out);
+#else
+  // Same blend order as EvalTrilinearScalar().
+  for (size_t i = 0; i < 3; i++) {
+    const float v00 = Lerp(d[i], d[SX + i], cell.fx);
+    const float v10 = Lerp(d[SY + i], d[SY + SX + i], cell.fx);
+    const float v01 = Lerp(d[SZ + i], d[SZ + SX + i], cell.fx);
+    const float v11 = Lerp(d[SZ + SY + i], d[SZ + SY + SX + i], cell.fx);
+    out[i] = Lerp(Lerp(v00, v10, cell.fy), Lerp(v01, v11, cell.fy), cell.fz);
+  }
+#endif
+}
+
+template <size_t X, size_t Y, size_t Z>
+void EvalTetrahedralFixed(const LUT3DViewf &lut, const float *rgb,
+                          float *out) {
+  static_assert((X > 1) && (Y > 1) && (Z > 1), "Invalid LUT dimensions");
+  constexpr size_t SX = 4;
+  constexpr size_t SY = SX * X;
+  constexpr size_t SZ = SY * Y;
+
+  LUTCell cell;
+  size_t x0, y0, z0, unused;
+  LUTCoord(rgb[0], X, &x0, &unused, &cell.fx);
+  LUTCoord(rgb[1], Y, &y0, &unused, &cell.fy);
+  LUTCoord(rgb[2], Z, &z0, &unused, &cell.fz);
+  const float *d = lut.data_ + (SZ * z0 + SY * y0 + SX * x0);
+
+#if defined(TINYCOLORIO_USE_SSE2)
+  __m128 c[8];
+  c[0] = _mm_loadu_ps(d);
+  c[1] = _mm_loadu_ps(d + SX);
+  c[2] = _mm_loadu_ps(d + SY);
+  c[3] = _mm_loadu_ps(d + SY + SX);
+  c[4] = _mm_loadu_ps(d + SZ);
+  c[5] = _mm_loadu_ps(d + SZ + SX);
+  c[6] = _mm_loadu_ps(d + SZ + SY);
+  c[7] = _mm_loadu_ps(d + SZ + SY + SX);
+  StoreRGB(Tetrahedral4(c, cell), out);
+#else
+  // Same blend order as EvalTetrahedralScalar().
+  int b, c;
+  float f[3];
+  LUTTetrahedron(cell, &b, &c, f);
+  const float *db = d + (SX * size_t(b & 1) + SY * size_t((b >> 1) & 1) +
+                         SZ * size_t(b >> 2));
+  const float *dc = d + (SX * size_t(c & 1) + SY * size_t((c >> 1) & 1) +
+                         SZ * size_t(c >> 2));
+  const float *d7 = d + (SX + SY + SZ);
+  for (size_t i = 0; i < 3; i++) {
+    out[i] = d[i] + (db[i] - d[i]) * f[0] + (dc[i] - db[i]) * f[1] +
+             (d7[i] - dc[i]) * f[2];
+  }
+#endif
+}
+
+}  // namespace
+
+void LUT3DEvaluator::init(const LUT3Df &lut) {
+  LUT3Df copy = lut;
+  init(std::move(copy));
+}
+
+void LUT3DEvaluator::init(LUT3Df &&lut) {
+  lut_ = std::move(lut);
+  lut_.convert(LUT3DLayout::kPaddedRGBA);
+  view_ = LUT3DViewf(lut_);
+  select();
+}
+
+void LUT3DEvaluator::init(const LUT3DViewf &lut) {
+  if (lut.layout() != LUT3DLayout::kPaddedRGBA) {
+    LUT3Df copy;
+    copy.create(lut.x_dim_, lut.y_dim_, lut.z_dim_, LUT3DLayout::kPaddedRGBA);
+    for (size_t z = 0; z < lut.z_dim_; z++) {
+      for (size_t y = 0; y < lut.y_dim_; y++) {
+        for (size_t x = 0; x < lut.x_dim_; x++) {
+          const size_t s = lut.index(x, y, z);
+          const size_t d = copy.index(x, y, z);
+          for (size_t c = 0; c < 3; c++) {
+            copy.data_[copy.offset(d, c)] = lut.data_[lut.offset(s, c)];
+          }
+        }
+      }
+    }
+    init(std::move(copy));
+    return;
+  }
+
+  lut_ = LUT3Df();
+  view_ = lut;
+  select();
+}
+
+void LUT3DEvaluator::select() {
+  const size_t n = view_.x_dim_;
+  const bool tetrahedral =
+      (interpolation_ == LUT3DInterpolation::kTetrahedral);
+  fixed_size_ = 0;
+  if (IsEmptyLUT(view_)) {
+    func_ = EvalEmpty;
+    return;
+  }
+  func_ = tetrahedral ? EvalGenericTetrahedral : EvalGeneric;
+  if ((view_.y_dim_ != n) || (view_.z_dim_ != n)) {
+    return;
+  }
+  if (n == 17) {
+    func_ = tetrahedral ? EvalTetrahedralFixed<17, 17, 17>
+                        : EvalTrilinearFixed<17, 17, 17>;
+  } else if (n == 33) {
+    func_ = tetrahedral ? EvalTetrahedralFixed<33, 33, 33>
+                        : EvalTrilinearFixed<33, 33, 33>;
+  } else if (n == 65) {
+    func_ = tetrahedral ? EvalTetrahedralFixed<65, 65, 65>
+                        : EvalTrilinearFixed<65, 65, 65>;
+  } else {
+    return;
+  }
+  fixed_size_ = n;
+}
+
+void EvalTrilinear(const LUT3DCellsf &cells, const float rgb[3],
+                   float out[3]) {
+  EvalBatch(cells, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+void EvalTrilinear(const LUT3DCellsh &cells, const float rgb[3],
+                   float out[3]) {
+  EvalBatch(cells, InterleavedPixels{rgb, out, 3, 3}, 1);
+}
+
+namespace {
+
+template <size_t N, LUT3DInterpolation I>
+struct FixedKernel {
+  const LUT3DViewf &lut;
+
+  void operator()(const float rgb[3], float out[3]) const {
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      EvalTetrahedralFixed<N, N, N>(lut, rgb, out);
+    } else {
+      EvalTrilinearFixed<N, N, N>(lut, rgb, out);
+    }
+  }
+};
+
+template <LUT3DInterpolation I, typename Pixels>
+void ApplyBatchImpl(const LUT3DEvaluator &evaluator, const Pixels &pixels,
+                    size_t count) {
+  const LUT3DViewf &lut = evaluator.view();
+  // The size specialized kernels keep up with the vector kernels except for
+  // tetrahedral interpolation with AVX2 or AVX-512F.
+  const SIMDLevel level = BatchSIMDLevel();
+  if ((evaluator.fixed_size() == 0) ||
+      ((I == LUT3DInterpolation::kTetrahedral) &&
+       (level >= SIMDLevel::kAVX2))) {
+    ApplyBatchImpl<I>(lut, pixels, count);
+    return;
+  }
+  switch (evaluator.fixed_size()) {
+    case 17:
+      RunBatch(FixedKernel<17, I>{lut}, pixels, count);
+      break;
+    case 33:
+      RunBatch(FixedKernel<33, I>{lut}, pixels, count);
+      break;
+    case 65:
+      RunBatch(FixedKernel<65, I>{lut}, pixels, count);
+      break;
+    default:
+      EvalBatch<I>(lut, pixels, count);
+      break;
+  }
+}
+
+template <typename LUT, typename Pixels>
+void ApplyBatchImpl(const LUT &lut, LUT3DInterpolation interpolation,
+                    const Pixels &pixels, size_t count) {
+  if (interpolation == LUT3DInterpolation::kTetrahedral) {
+    ApplyBatchImpl<LUT3DInterpolation::kTetrahedral>(lut, pixels, count);
+  } else {
+    ApplyBatchImpl<LUT3DInterpolation::kTrilinear>(lut, pixels, count);
+  }
+}
+
+}  // namespace
+
+void ApplyBatch(const LUT3DViewf &lut, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride,
+                LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation,
+                 InterleavedPixels{src, dst, src_stride, dst_stride}, count);
+}
+
+void ApplyBatch(const LUT3DViewu16 &lut, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride,
+                LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation,
+                 InterleavedPixels{src, dst, src_stride, dst_stride}, count);
+}
+
+void ApplyBatch(const LUT3DViewh &lut, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride,
+                LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation,
+                 InterleavedPixels{src, dst, src_stride, dst_stride}, count);
+}
+
+void ApplyBatch(const LUT3DCellsf &cells, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride) {
+  EvalBatch(cells, InterleavedPixels{src, dst, src_stride, dst_stride},
+            count);
+}
+
+void ApplyBatch(const LUT3DCellsh &cells, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride) {
+  EvalBatch(cells, InterleavedPixels{src, dst, src_stride, dst_stride},
+            count);
+}
+
+void ApplyBatch(const LUT3DEvaluator &evaluator, const float *src, float *dst,
+                size_t count, size_t src_stride, size_t dst_stride) {
+  ApplyBatchImpl(evaluator, evaluator.interpolation(),
+                 InterleavedPixels{src, dst, src_stride, dst_stride}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DViewf &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation, PlanarPixels{src, dst}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DViewu16 &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation, PlanarPixels{src, dst}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DViewh &lut, const float *const src[3],
+                      float *const dst[3], size_t count,
+                      LUT3DInterpolation interpolation) {
+  ApplyBatchImpl(lut, interpolation, PlanarPixels{src, dst}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DCellsf &cells, const float *const src[3],
+                      float *const dst[3], size_t count) {
+  EvalBatch(cells, PlanarPixels{src, dst}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DCellsh &cells, const float *const src[3],
+                      float *const dst[3], size_t count) {
+  EvalBatch(cells, PlanarPixels{src, dst}, count);
+}
+
+void ApplyBatchPlanar(const LUT3DEvaluator &evaluator,
+                      const float *const src[3], float *const dst[3],
+                      size_t count) {
+  ApplyBatchImpl(evaluator, evaluator.interpolation(),
+                 PlanarPixels{src, dst}, count);
+}
+
+SIMDLevel SetMaxSIMDLevel(SIMDLevel level) {
+  return SIMDLevel(MaxSIMDLevel().exchange(uint32_t(level)));
+}
+
+SIMDLevel GetSIMDLevel() { return BatchSIMDLevel(); }
+
+//
+// Integer evaluation
+//
+
+constexpr uint32_t LUT3DIntegerEvaluator::kWeightBits;
+constexpr uint32_t LUT3DIntegerEvaluator::kOne;
+
+bool LUT3DIntegerEvaluator::init(const LUT3DViewf &lut, int in_bits,
+                                 int out_bits, std::string *err) {
+  if ((in_bits < 8) || (in_bits > 16) || (out_bits < 8) || (out_bits > 16)) {
+    if (err) {
+      (*err) = "Bits per component must be 8 to 16. in_bits = " +
+               std::to_string(in_bits) +
+               ", out_bits = " + std::to_string(out_bits);
+    }
+    return false;
+  }
+
+  const size_t dims[3] = {lut.x_dim_, lut.y_dim_, lut.z_dim_};
+  size_t num_values = 4;
+  for (size_t d : dims) {
+    if (!MulSize(num_values, d, &num_values)) {
+      num_values = 0;
+      break;
+    }
+  }
+  if ((lut.data_ == nullptr) || (num_values == 0)) {
+    if (err) {
+      (*err) = "Empty 3D LUT.";
+    }
+    return false;
+  }
+  if (num_values > std::numeric_limits<uint32_t>::max()) {
+    if (err) {
+      (*err) = "3D LUT is too large for LUT3DIntegerEvaluator.";
+    }
+    return false;
+  }
+
+  output_shift_ = uint32_t(16 - out_bits);
+  const double out_scale =
+      double((1u << out_bits) - 1) * double(1u << output_shift_);
+
+  // kPaddedRGBA, x fastest.
+  const size_t strides[3] = {4, 4 * dims[0], 4 * dims[0] * dims[1]};
+  data_.resize(num_values);
+  for (size_t z = 0; z < dims[2]; z++) {
+    for (size_t y = 0; y < dims[1]; y++) {
+      for (size_t x = 0; x < dims[0]; x++) {
+        const size_t idx = lut.index(x, y, z);
+        uint16_t *d = &data_[strides[2] * z + strides[1] * y + 4 * x];
+        for (size_t c = 0; c < 3; c++) {
+          float v = lut.data_[lut.offset(idx, c)];
+          if (!(v > 0.0f)) {
+            v = 0.0f;  // also handles NaN
+          } else if (v > 1.0f) {
+            v = 1.0f;
+          }
+          d[c] = uint16_t(double(v) * out_scale + 0.5);
+        }
+        d[3] = 0;
+      }
+    }
+  }
+
+  max_code_ = uint16_t((1u << in_bits) - 1);
+  for (size_t a = 0; a < 3; a++) {
+    step_[a] = (dims[a] > 1) ? strides[a] : 0;
+    axis_[a].resize(size_t(max_code_) + 1);
+    for (size_t code = 0; code <= max_code_; code++) {
+      AxisStep &step = axis_[a][code];
+      if (dims[a] < 2) {
+        step.offset = 0;
+        step.weight = 0;
+        continue;
+      }
+      const double p =
+          double(code) * double(dims[a] - 1) / double(max_code_);
+      const size_t i = std::min(size_t(p), dims[a] - 2);
+      step.offset = uint32_t(i * strides[a]);
+      step.weight =
+          uint32_t((p - double(i)) * double(kOne) + 0.5);
+    }
+  }
+
+  in_bits_ = in_bits;
+  out_bits_ = out_bits;
+  return true;
+}
+
+namespace {
+
+template <LUT3DInterpolation I, typename S, typename D>
+void ApplyBatchInteger(const LUT3DIntegerEvaluator &evaluator, const S *src,
+                       D *dst, size_t count, size_t src_stride,
+                       size_t dst_stride) {
+  for (size_t i = 0; i < count; i++) {
+    const S *s = src + i * src_stride;
+    const uint16_t rgb[3] = {s[0], s[1], s[2]};
+    uint16_t out[3];
+    if (I == LUT3DInterpolation::kTetrahedral) {
+      evaluator.eval_tetrahedral(rgb, out);
+    } else {
+      evaluator.eval_trilinear(rgb, out);
+    }
+    D *d = dst + i * dst_stride;
+    d[0] = D(out[0]);
+    d[1] = D(out[1]);
+    d[2] = D(out[2]);
+  }
+}
+
+template <typename S, typename D>
+bool ApplyBatchInteger(const LUT3DIntegerEvaluator &evaluator, const S *src,
+                       D *dst, size_t count, size_t src_stride,
+                       size_t dst_stride) {
+  // uint8_t pixels only hold 8-bit codes.
+  if ((evaluator.in_bits() == 0) ||
+      ((sizeof(S) == 1) && (evaluator.in_bits() != 8)) ||
+      ((sizeof(D) == 1) && (evaluator.out_bits() != 8))) {
+    return false;
+  }
+
+  if (evaluator.interpolation() == LUT3DInterpolation::kTetrahedral) {
+    ApplyBatchInteger<LUT3DInterpolation::kTetrahedral>(
+        evaluator, src, dst, count, src_stride, dst_stride);
+  } else {
+    ApplyBatchInteger<LUT3DInterpolation::kTrilinear>(
+        evaluator, src, dst, count, src_stride, dst_stride);
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint8_t *src,
+                uint8_t *dst, size_t count, size_t src_stride,
+                size_t dst_stride) {
+  return ApplyBatchInteger(evaluator, src, dst, count, src_stride, dst_stride);
+}
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint8_t *src,
+                uint16_t *dst, size_t count, size_t src_stride,
+                size_t dst_stride) {
+  return ApplyBatchInteger(evaluator, src, dst, count, src_stride, dst_stride);
+}
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint16_t *src,
+                uint8_t *dst, size_t count, size_t src_stride,
+                size_t dst_stride) {
+  return ApplyBatchInteger(evaluator, src, dst, count, src_stride, dst_stride);
+}
+
+bool ApplyBatch(const LUT3DIntegerEvaluator &evaluator, const uint16_t *src,
+                uint16_t *dst, size_t count, size_t src_stride,
+                size_t dst_stride) {
+  return ApplyBatchInteger(evaluator, src, dst, count, src_stride, dst_stride);
+}
+
+//
+// Asynchronous loading
+//
+
+ThreadPool::ThreadPool(size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    threads_.emplace_back([this]() { run(); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto &th : threads_) {
+    th.join();
+  }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+ThreadPool &ThreadPool::default_pool() {
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;  // stop_ and drained
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+namespace {
+
+bool IsLUTBinary(const MappedFile &file) {
+  return (file.size() >= sizeof(kLUTBinaryMagic)) &&
+         (memcmp(file.data(), kLUTBinaryMagic, sizeof(kLUTBinaryMagic)) == 0);
+}
+
+// Loads spi3d or binary container.
+bool LoadLUTFromFile(const std::string &filename, const LoadOptions &options,
+                     LUT3Df *lut, std::string *err) {
+  MappedFile file;
+  if (!file.open(filename, err)) {
+    return false;
+  }
+
+  if (IsLUTBinary(file)) {
+    return LoadLUTBinaryFromMemory(file.data(), file.size(), lut, options,
+                                   err);
+  }
+  return LoadSPI3DFromMemory(file.data(), file.size(), lut, options, err);
+}
+
+// Loads spi1d or binary container.
+bool LoadLUTFromFile(const std::string &filename, const LoadOptions &options,
+                     LUT1Df *lut, std::string *err) {
+  MappedFile file;
+  if (!file.open(filename, err)) {
+    return false;
+  }
+
+  if (IsLUTBinary(file)) {
+    return LoadLUTBinaryFromMemory(file.data(), file.size(), lut, options,
+                                   err);
+  }
+  return LoadSPI3DFromMemory(file.data(), file.size(), lut, options, err);
+}
+
+template <typename LUT>
+LUTLoadTask<LUT> LoadLUTFromFileAsync(const std::string &filename,
+                                      const LoadOptions &options,
+                                      ThreadPool *pool) {
+  auto state = std::make_shared<LUTLoadState<LUT>>();
+  auto done = std::make_shared<std::promise<void>>();
+  std::shared_future<void> future = done->get_future().share();
+
+  (pool ? pool : &ThreadPool::default_pool())
+      ->submit([state, done, filename, options]() {
+        LoadOptions opts = options;
+        opts.cancel = &state->cancel;
+        const std::function<void(float)> progress = options.progress;
+        opts.progress = [&state, &progress](float v) {
+          state->progress = v;
+          if (progress) {
+            progress(v);
+          }
+        };
+
+        // Always complete the task, even when allocation or the user's
+        // progress callback throws.
+        try {
+          state->ok =
+              !IsCancelled(opts, &state->err) &&
+              LoadLUTFromFile(filename, opts, &state->lut, &state->err);
+        } catch (const std::exception &e) {
+          state->ok = false;
+          state->err = std::string("LUT loading failed : ") + e.what();
+        } catch (...) {
+          state->ok = false;
+          state->err = "LUT loading failed with an unknown exception.";
+        }
+        if (state->ok) {
+          state->progress = 1.0f;
+        }
+        done->set_value();
+      });
+
+  return LUTLoadTask<LUT>(std::move(state), std::move(future));
+}
+
+}  // namespace
+
+LUTLoadTask<LUT3Df> LoadLUT3DFromFileAsync(const std::string &filename,
+                                           const LoadOptions &options,
+                                           ThreadPool *pool) {
+  return LoadLUTFromFileAsync<LUT3Df>(filename, options, pool);
+}
+
+LUTLoadTask<LUT1Df> LoadLUT1DFromFileAsync(const std::string &filename,
+                                           const LoadOptions &options,
+                                           ThreadPool *pool) {
+  return LoadLUTFromFileAsync<LUT1Df>(filename, options, pool);
+}
+
+
+//
+// Batch loading
+//
+
+namespace {
+
+// Max files open(read buffer allocated) at once in LoadLUTFiles().
+constexpr size_t kMaxOpenBatchFiles = 64;
+
+struct BatchFile {
+  int fd{-1};
+  std::unique_ptr<char[]> buf;  // uninitialized until read
+  size_t size{0};
+  size_t offset{0};  // bytes read so far
+};
+
+bool CheckBatchFileSize(const std::string &filename, size_t size,
+                        const LoadOptions &options, std::string *err) {
+  if ((options.max_memory > 0) && (size > options.max_memory)) {
+    if (err) {
+      (*err) = "File size exceeds max_memory " +
+               std::to_string(options.max_memory) + " bytes : " + filename;
+    }
+    return false;
+  }
+  return true;
+}
+
+// Opens `filename` and allocates its read buffer.
+bool OpenBatchFile(const std::string &filename, const LoadOptions &options,
+                   BatchFile *file, std::string *err) {
+#if !defined(_WIN32)
+  file->fd = ::open(filename.c_str(), O_RDONLY);
+  if (file->fd < 0) {
+    if (err) {
+      (*err) = "Failed to open file : " + filename;
+    }
+    return false;
+  }
+
+  struct stat st;
+  if ((fstat(file->fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+    if (err) {
+      (*err) = "Not a regular file : " + filename;
+    }
+    return false;
+  }
+  if (!CheckBatchFileSize(filename, size_t(st.st_size), options, err)) {
+    return false;
+  }
+  file->size = size_t(st.st_size);
+  file->buf.reset(new char[file->size]);
+  return true;
+#else
+  // Read by MappedFile in ReadBatchFile().
+  (void)filename;
+  (void)options;
+  (void)file;
+  (void)err;
+  return true;
+#endif
+}
+
+void CloseBatchFile(BatchFile *file) {
+#if !defined(_WIN32)
+  if (file->fd >= 0) {
+    ::close(file->fd);
+  }
+#endif
+  file->fd = -1;
+  file->buf.reset();
+  file->size = 0;
+}
+
+// Detects the format of a read file and parses it into `result`.
+void ParseBatchFile(const BatchFile &file, const LoadOptions &options,
+                    LUTBatchResult *result) {
+  const char *data = file.buf.get();
+  const size_t size = file.size;
+  LUTInfo info;
+  if (!ProbeLUTMemory(data, size, &info, &result->err)) {
+    return;
+  }
+
+  result->format = info.format;
+  result->num_dims = info.num_dims;
+  if (info.format == LUTFormat::kBinary) {
+    result->ok = (info.num_dims == 3)
+                     ? LoadLUTBinaryFromMemory(data, size, &result->lut3d,
+                                               options, &result->err)
+                     : LoadLUTBinaryFromMemory(data, size, &result->lut1d,
+                                               options, &result->err);
+  } else if (info.format == LUTFormat::kSPI3D) {
+    result->ok = LoadSPI3DFromMemory(data, size, &result->lut3d, options,
+                                     &result->err);
+  } else {
+    result->ok = LoadSPI3DFromMemory(data, size, &result->lut1d, options,
+                                     &result->err);
+  }
+}
+
+// Reads the rest of `file` with pread().
+bool ReadBatchFile(const std::string &filename, const LoadOptions &options,
+                   BatchFile *file, std::string *err) {
+#if !defined(_WIN32)
+  (void)options;
+  while (file->offset < file->size) {
+    ssize_t n = pread(file->fd, file->buf.get() + file->offset,
+                      file->size - file->offset, off_t(file->offset));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      if (err) {
+        (*err) = "Failed to read file : " + filename;
+      }
+      return false;
+    }
+    file->offset += size_t(n);
+  }
+  return true;
+#else
+  MappedFile mapped;
+  if (!mapped.open(filename, err) ||
+      !CheckBatchFileSize(filename, mapped.size(), options, err)) {
+    return false;
+  }
+  file->size = mapped.size();
+  file->buf.reset(new char[file->size]);
+  memcpy(file->buf.get(), mapped.data(), file->size);
+  file->offset = file->size;
+  return true;
+#endif
+}
+
+#if defined(TINYCOLORIO_USE_IO_URING)
+
+///
+/// Minimal io_uring wrapper using raw syscalls(no liburing dependency).
+///
+class IoUring {
+ public:
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+
+  ~IoUring() {
+    if (sqes_) {
+      munmap(sqes_, sqes_len_);
+    }
+    if (cq_ptr_ && (cq_ptr_ != sq_ptr_)) {
+      munmap(cq_ptr_, cq_len_);
+    }
+    if (sq_ptr_) {
+      munmap(sq_ptr_, sq_len_);
+    }
+    if (fd_ >= 0) {
+      ::close(fd_);
+    }
+  }
+
+  bool init(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = int(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0) {
+      return false;
+    }
+    fd_ = fd;
+
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+    }
+
+    void *sq = mmap(nullptr, sq_len_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+      return false;
+    }
+    sq_ptr_ = sq;
+
+    if (single_mmap) {
+      cq_ptr_ = sq_ptr_;
+    } else {
+      void *cq = mmap(nullptr, cq_len_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED) {
+        return false;
+      }
+      cq_ptr_ = cq;
+    }
+
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+      return false;
+    }
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sqp = static_cast<char *>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sqp + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.array);
+
+    char *cqp = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cqp + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cqp + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cqp + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cqp + p.cq_off.cqes);
+
+    entries_ = p.sq_entries;
+    return true;
+  }
+
+  unsigned entries() const { return entries_; }
+
+  // Queues a read. Caller keeps in-flight requests <= entries().
+  void queue_read(int fd, void *buf, unsigned len, uint64_t offset,
+                  uint64_t user_data) {
+    unsigned tail = *sq_tail_;
+    unsigned idx = tail & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sq_array_[idx] = idx;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    pending_++;
+  }
+
+  // Submits queued reads and waits for at least one completion.
+  bool submit_and_wait() {
+    while (true) {
+      int ret = int(syscall(__NR_io_uring_enter, fd_, pending_, 1,
+                            IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (ret >= 0) {
+        const unsigned submitted = std::min(pending_, unsigned(ret));
+        pending_ -= submitted;
+        in_kernel_ += submitted;
+        return true;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Waits for at least one completion without submitting queued reads.
+  bool wait() {
+    while (true) {
+      int ret = int(syscall(__NR_io_uring_enter, fd_, 0, 1,
+                            IORING_ENTER_GETEVENTS, nullptr, 0));
+      if (ret >= 0) {
+        return true;
+      }
+      if (errno != EINTR) {
+        return false;
+      }
+    }
+  }
+
+  // Number of submitted reads whose completion has not been popped yet.
+  unsigned in_kernel() const { return in_kernel_; }
+
+  // Pops one completion. Returns false when the queue is empty.
+  bool pop(uint64_t *user_data, int *res) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    const io_uring_cqe &cqe = cqes_[head & cq_mask_];
+    (*user_data) = cqe.user_data;
+    (*res) = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    in_kernel_ -= std::min(in_kernel_, 1u);
+    return true;
+  }
+
+ private:
+  int fd_{-1};
+  unsigned entries_{0};
+  unsigned pending_{0};
+  unsigned in_kernel_{0};
+  void *sq_ptr_{nullptr};
+  void *cq_ptr_{nullptr};
+  size_t sq_len_{0};
+  size_t cq_len_{0};
+  io_uring_sqe *sqes_{nullptr};
+  size_t sqes_len_{0};
+  unsigned *sq_head_{nullptr};
+  unsigned *sq_tail_{nullptr};
+  unsigned sq_mask_{0};
+  unsigned *sq_array_{nullptr};
+  unsigned *cq_head_{nullptr};
+  unsigned *cq_tail_{nullptr};
+  unsigned cq_mask_{0};
+  io_uring_cqe *cqes_{nullptr};
+};
+
+// Max bytes per read request.
+constexpr size_t kMaxIoUringReadSize = size_t(1) << 30;
+
+///
+/// Reads files through io_uring and calls `on_read(i, ok)` as each file
+/// completes. `open_next(wait, &i)` opens the next file to read. It returns
+/// false when every file has been handed out or, unless `wait`, no file can be
+/// opened yet. Returns false when io_uring is unavailable(no file has been
+/// opened in that case).
+///
+bool ReadBatchFilesIoUring(
+    std::vector<BatchFile> *files,
+    const std::function<bool(bool, size_t *)> &open_next,
+    const std::function<void(size_t, bool)> &on_read) {
+  std::vector<size_t> unfinished;
+  {
+    IoUring ring;
+    if (!ring.init(unsigned(std::min(files->size(), kMaxOpenBatchFiles)))) {
+      return false;
+    }
+
+    auto queue = [&](size_t i) {
+      BatchFile &f = (*files)[i];
+      size_t len = std::min(f.size - f.offset, kMaxIoUringReadSize);
+      ring.queue_read(f.fd, f.buf.get() + f.offset, unsigned(len),
+                      uint64_t(f.offset), uint64_t(i));
+    };
+
+    std::vector<char> in_flight(files->size(), 0);
+    size_t num_in_flight = 0;
+    bool ring_ok = true;
+    for (;;) {
+      // Only block for a free slot when nothing is in flight; the slots are
+      // released by parse tasks of completed reads.
+      size_t next;
+      while (ring_ok && (num_in_flight < ring.entries()) &&
+             open_next(num_in_flight == 0, &next)) {
+        in_flight[next] = 1;
+        queue(next);
+        num_in_flight++;
+      }
+      if (num_in_flight == 0) {
+        break;
+      }
+
+      if (ring_ok) {
+        ring_ok = ring.submit_and_wait();
+      }
+      if (!ring_ok) {
+        // Reads already submitted still write into their buffers, so wait
+        // for them before pread() reuses(and CloseBatchFile() frees) the
+        // buffers. Reads never submitted are left to pread() as they are.
+        if (ring.in_kernel() == 0) {
+          break;
+        }
+        if (!ring.wait()) {
+          // The kernel may still own the buffers. Leak them and let
+          // pread() start over in fresh ones.
+          for (size_t i = 0; i < in_flight.size(); i++) {
+            if (in_flight[i]) {
+              BatchFile &f = (*files)[i];
+              (void)f.buf.release();
+              f.buf.reset(new char[f.size]);
+              f.offset = 0;
+            }
+          }
+          break;
+        }
+      }
+
+      uint64_t i;
+      int res;
+      while (ring.pop(&i, &res)) {
+        BatchFile &f = (*files)[size_t(i)];
+        if ((res > 0) && ((f.offset + size_t(res)) < f.size)) {
+          // Short read. Queue the rest, or leave it to pread() when the
+          // ring failed.
+          f.offset += size_t(res);
+          if (ring_ok) {
+            queue(size_t(i));
+          }
+          continue;
+        }
+
+        in_flight[size_t(i)] = 0;
+        num_in_flight--;
+        if (res > 0) {
+          f.offset += size_t(res);
+          on_read(size_t(i), true);
+        } else {
+          // Error, EOF or IORING_OP_READ unsupported(pre 5.6 kernel).
+          on_read(size_t(i), false);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < in_flight.size(); i++) {
+      if (in_flight[i]) {
+        unfinished.push_back(i);
+      }
+    }
+  }
+
+  for (size_t i : unfinished) {
+    on_read(i, false);
+  }
+  return true;
+}
+
+#endif  // TINYCOLORIO_USE_IO_URING
+
+}  // namespace
+
+bool LoadLUTFiles(const std::vector<std::string> &filenames,
+                  std::vector<LUTBatchResult> *results,
+                  const LoadOptions &options, ThreadPool *pool) {
+  if (!results) {
+    return false;
+  }
+
+  if (!pool) {
+    pool = &ThreadPool::default_pool();
+  }
+
+  const size_t n = filenames.size();
+  results->clear();
+  results->resize(n);
+
+  std::vector<BatchFile> files(n);
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t remaining = n;
+  size_t num_open = 0;  // files holding a read buffer
+
+  auto finish = [&](size_t i) {
+    // Release the file content as early as possible.
+    CloseBatchFile(&files[i]);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    num_open--;
+    remaining--;
+    cv.notify_all();
+  };
+
+  // Files are opened(and their buffers allocated) only within a window of
+  // kMaxOpenBatchFiles, so the read buffers of a large batch do not all
+  // exist at once.
+  size_t next = 0;
+  auto open_next = [&](bool wait, size_t *id) {
+    while (next < n) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!wait && (num_open >= kMaxOpenBatchFiles)) {
+          return false;
+        }
+        cv.wait(lock, [&]() { return num_open < kMaxOpenBatchFiles; });
+        num_open++;
+      }
+
+      const size_t i = next++;
+      if (OpenBatchFile(filenames[i], options, &files[i],
+                        &(*results)[i].err)) {
+        (*id) = i;
+        return true;
+      }
+      finish(i);
+    }
+    return false;
+  };
+
+  // Parses a read file(or reads it with pread() first) on the pool.
+  auto on_read = [&](size_t i, bool read_ok) {
+    pool->submit([&, i, read_ok]() {
+      BatchFile &f = files[i];
+      LUTBatchResult &r = (*results)[i];
+      if (read_ok || ReadBatchFile(filenames[i], options, &f, &r.err)) {
+        ParseBatchFile(f, options, &r);
+      }
+      finish(i);
+    });
+  };
+
+#if defined(TINYCOLORIO_USE_IO_URING)
+  if (n > 0) {
+    ReadBatchFilesIoUring(&files, open_next, on_read);
+  }
+#endif
+  // pread() fallback. Nothing is left here when io_uring read every file.
+  size_t id;
+  while (open_next(true, &id)) {
+    on_read(id, false);
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return remaining == 0; });
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < n; i++) {
+    ok &= (*results)[i].ok;
+  }
+  return ok;
 }
 
 }  // namespace tinycolorio